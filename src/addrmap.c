@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * Address map: a radix tree mapping integer keys (e.g. the block address
+ * offsets divided by some granularity) to pointers.
+ *
+ * Notes
+ *
+ *	Each node has 64 slots and a bitmap of the used slots.  The depth
+ *	of the tree is fixed at creation time, based on the maximum key,
+ *	therefore all operations take O(log64 n) time.  The bitmaps are
+ *	used to find the nearest lower key, i.e. the predecessor, without
+ *	visiting the empty slots.
+ *
+ *	The nodes are allocated on demand and freed once they become empty,
+ *	therefore a sparse key space does not consume much memory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include "addrmap.h"
+#include "utils.h"
+
+#define	ADDRMAP_SHIFT		6
+#define	ADDRMAP_FANOUT		(1U << ADDRMAP_SHIFT)
+#define	ADDRMAP_MASK		(ADDRMAP_FANOUT - 1)
+#define	ADDRMAP_MAXLVL		\
+    ((CHAR_BIT * sizeof(uintptr_t) + ADDRMAP_SHIFT - 1) / ADDRMAP_SHIFT)
+
+typedef struct addrmap_node {
+	uint64_t		bitmap;
+	void *			slot[ADDRMAP_FANOUT];
+} addrmap_node_t;
+
+struct addrmap {
+	addrmap_node_t		root;
+	unsigned		levels;
+};
+
+static inline unsigned
+addrmap_idx(uintptr_t key, unsigned level)
+{
+	return (key >> (level * ADDRMAP_SHIFT)) & ADDRMAP_MASK;
+}
+
+/*
+ * addrmap_create: construct the map for the keys in [0 .. maxkey] range.
+ */
+addrmap_t *
+addrmap_create(uintptr_t maxkey)
+{
+	const unsigned bits = flsl(maxkey);
+	addrmap_t *map;
+
+	if ((map = calloc(1, sizeof(addrmap_t))) == NULL) {
+		return NULL;
+	}
+	map->levels = bits ? (bits + ADDRMAP_SHIFT - 1) / ADDRMAP_SHIFT : 1;
+	ASSERT(map->levels <= ADDRMAP_MAXLVL);
+	return map;
+}
+
+static void
+addrmap_free_node(addrmap_node_t *node, unsigned level)
+{
+	uint64_t bitmap = node->bitmap;
+
+	if (level == 0) {
+		/* Leaf: the slots hold the values. */
+		return;
+	}
+	while (bitmap) {
+		addrmap_node_t *child = node->slot[ffs64(bitmap) - 1];
+
+		addrmap_free_node(child, level - 1);
+		free(child);
+		bitmap &= bitmap - 1;
+	}
+}
+
+void
+addrmap_destroy(addrmap_t *map)
+{
+	addrmap_free_node(&map->root, map->levels - 1);
+	free(map);
+}
+
+/*
+ * addrmap_clear: remove all keys and, if the value is not NULL, set the
+ * zero key to it.  The nodes on the path of the zero key are kept, so
+ * the key is then set without an allocation.  Returns 0 on success and
+ * -1 on failure (only if the path did not exist).
+ */
+int
+addrmap_clear(addrmap_t *map, void *val)
+{
+	addrmap_node_t *node = &map->root;
+	unsigned level;
+
+	for (level = map->levels - 1; level; level--) {
+		const uint64_t keep = val ? (node->bitmap & 1) : 0;
+		uint64_t bitmap = node->bitmap & ~keep;
+
+		while (bitmap) {
+			const unsigned i = ffs64(bitmap) - 1;
+			addrmap_node_t *child = node->slot[i];
+
+			addrmap_free_node(child, level - 1);
+			free(child);
+			node->slot[i] = NULL;
+			bitmap &= bitmap - 1;
+		}
+		node->bitmap = keep;
+		if (!keep) {
+			break;
+		}
+		node = node->slot[0];
+	}
+	if (level == 0) {
+		memset(node, 0, sizeof(addrmap_node_t));
+	}
+
+	/*
+	 * The kept nodes are empty until the key is set: the lookups
+	 * expect every linked subtree to be non-empty.
+	 */
+	return val ? addrmap_set(map, 0, val) : 0;
+}
+
+/*
+ * addrmap_prune: free the empty nodes on the path of the given key,
+ * starting from the given level upwards.  The root is never freed.
+ */
+static void
+addrmap_prune(addrmap_t *map, addrmap_node_t **path, uintptr_t key,
+    unsigned level)
+{
+	while (level < map->levels - 1) {
+		addrmap_node_t *node = path[level], *parent = path[level + 1];
+		const unsigned i = addrmap_idx(key, level + 1);
+
+		if (node->bitmap) {
+			break;
+		}
+		ASSERT(parent->slot[i] == node);
+		parent->bitmap &= ~(UINT64_C(1) << i);
+		parent->slot[i] = NULL;
+		free(node);
+		level++;
+	}
+}
+
+/*
+ * addrmap_set: set the value of the given key, replacing the existing
+ * value, if any.  Returns 0 on success and -1 on failure.
+ */
+int
+addrmap_set(addrmap_t *map, uintptr_t key, void *val)
+{
+	addrmap_node_t *path[ADDRMAP_MAXLVL];
+	addrmap_node_t *node = &map->root;
+	unsigned level = map->levels - 1;
+	unsigned i;
+
+	ASSERT(val != NULL);
+
+	while (level) {
+		i = addrmap_idx(key, level);
+		path[level] = node;
+
+		if ((node->bitmap & (UINT64_C(1) << i)) == 0) {
+			addrmap_node_t *child;
+
+			if ((child = calloc(1, sizeof(addrmap_node_t))) == NULL) {
+				addrmap_prune(map, path, key, level);
+				return -1;
+			}
+			node->slot[i] = child;
+			node->bitmap |= UINT64_C(1) << i;
+		}
+		node = node->slot[i];
+		level--;
+	}
+	i = addrmap_idx(key, 0);
+	node->slot[i] = val;
+	node->bitmap |= UINT64_C(1) << i;
+	return 0;
+}
+
+/*
+ * addrmap_del: remove the given key from the map, if present.
+ */
+void
+addrmap_del(addrmap_t *map, uintptr_t key)
+{
+	addrmap_node_t *path[ADDRMAP_MAXLVL];
+	addrmap_node_t *node = &map->root;
+	unsigned level = map->levels - 1;
+	unsigned i;
+
+	while (level) {
+		i = addrmap_idx(key, level);
+		path[level] = node;
+
+		if ((node->bitmap & (UINT64_C(1) << i)) == 0) {
+			return;
+		}
+		node = node->slot[i];
+		level--;
+	}
+	i = addrmap_idx(key, 0);
+	path[0] = node;
+	node->bitmap &= ~(UINT64_C(1) << i);
+	node->slot[i] = NULL;
+	addrmap_prune(map, path, key, 0);
+}
+
+/*
+ * addrmap_get: return the value of the given key or NULL, if none.
+ */
+void *
+addrmap_get(const addrmap_t *map, uintptr_t key)
+{
+	const addrmap_node_t *node = &map->root;
+	unsigned level = map->levels - 1;
+	unsigned i;
+
+	while (level) {
+		i = addrmap_idx(key, level);
+		if ((node->bitmap & (UINT64_C(1) << i)) == 0) {
+			return NULL;
+		}
+		node = node->slot[i];
+		level--;
+	}
+	return node->slot[addrmap_idx(key, 0)];
+}
+
+/*
+ * addrmap_get_le: return the value of the given key or, if none, the
+ * value of the nearest lower key.  Returns NULL if there is no such key.
+ */
+void *
+addrmap_get_le(const addrmap_t *map, uintptr_t key)
+{
+	const addrmap_node_t *path[ADDRMAP_MAXLVL];
+	const addrmap_node_t *node = &map->root;
+	unsigned level = map->levels - 1;
+	uint64_t mask;
+	unsigned i;
+
+	/*
+	 * Descend following the key, while its path exists.
+	 */
+	for (;;) {
+		i = addrmap_idx(key, level);
+		path[level] = node;
+
+		if (level == 0) {
+			/* The slot itself or the nearest lower one. */
+			mask = node->bitmap & (UINT64_MAX >> (ADDRMAP_MASK - i));
+			if (mask) {
+				return node->slot[fls64(mask) - 1];
+			}
+			if (map->levels == 1) {
+				return NULL;
+			}
+			i = addrmap_idx(key, ++level);
+			break;
+		}
+		if ((node->bitmap & (UINT64_C(1) << i)) == 0) {
+			break;
+		}
+		node = node->slot[i];
+		level--;
+	}
+
+	/*
+	 * Go upwards until there is a lower subtree.
+	 */
+	for (;;) {
+		mask = path[level]->bitmap & ((UINT64_C(1) << i) - 1);
+		if (mask) {
+			break;
+		}
+		if (++level == map->levels) {
+			return NULL;
+		}
+		i = addrmap_idx(key, level);
+	}
+	node = path[level]->slot[fls64(mask) - 1];
+
+	/*
+	 * Descend to the highest key of the subtree.
+	 */
+	while (--level) {
+		node = node->slot[fls64(node->bitmap) - 1];
+	}
+	return node->slot[fls64(node->bitmap) - 1];
+}
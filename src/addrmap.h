@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+#ifndef _ADDRMAP_H_
+#define _ADDRMAP_H_
+
+#include <inttypes.h>
+
+#include "utils.h"
+
+struct addrmap;
+typedef struct addrmap addrmap_t;
+
+addrmap_t *	addrmap_create(uintptr_t) __dso_hidden;
+void		addrmap_destroy(addrmap_t *) __dso_hidden;
+int		addrmap_clear(addrmap_t *, void *) __dso_hidden;
+
+int		addrmap_set(addrmap_t *, uintptr_t, void *) __dso_hidden;
+void		addrmap_del(addrmap_t *, uintptr_t) __dso_hidden;
+void *		addrmap_get(const addrmap_t *, uintptr_t) __dso_hidden;
+void *		addrmap_get_le(const addrmap_t *, uintptr_t) __dso_hidden;
+
+#endif
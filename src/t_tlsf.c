@@ -15,6 +15,8 @@
 #include <err.h>
 
 #include "tlsf.h"
+#include "tlsf_inline.h"
+#include "addrmap.h"
 #include "utils.h"
 
 static void
@@ -51,7 +53,1459 @@ basic_test(void)
 }
 
 static void
-random_test(const size_t spacelen, const size_t cap, tlsf_mode_t mode)
+ext_resize_test(bool defer)
+{
+	const size_t len = 64 * 1024;
+	tlsf_blk_t *blk, *blk2, *blk3;
+	uintptr_t addr, addr2;
+	tlsf_t *tlsf;
+	size_t blen;
+
+	tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+	assert(tlsf != NULL);
+	if (defer) {
+		assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 64) == 0);
+	}
+
+	blk = tlsf_ext_alloc(tlsf, 4096);
+	assert(blk != NULL);
+	addr = tlsf_ext_getaddr(blk, &blen);
+	assert(blen == 4096);
+
+	/* Trim the tail: the space must come back to the free lists. */
+	assert(tlsf_ext_trim(tlsf, blk, 100) == 0);
+	assert(tlsf_ext_getaddr(blk, &blen) == addr);
+	assert(blen == 128);
+	assert(tlsf_unused_space(tlsf) == len - 128);
+
+	/* Cannot trim to a larger size. */
+	assert(tlsf_ext_trim(tlsf, blk, 256) == -1);
+
+	/* Extend into the free block which follows. */
+	assert(tlsf_ext_extend(tlsf, blk, 8192) == 0);
+	assert(tlsf_ext_getaddr(blk, &blen) == addr);
+	assert(blen == 8192);
+	assert(tlsf_unused_space(tlsf) == len - 8192);
+
+	/* Allocate the next block: extension must fail. */
+	blk2 = tlsf_ext_alloc(tlsf, len - 8192);
+	assert(blk2 != NULL);
+	addr2 = tlsf_ext_getaddr(blk2, NULL);
+	assert(addr2 == addr + 8192);
+	assert(tlsf_ext_extend(tlsf, blk, 8192 + 32) == -1);
+
+	/* Free the neighbour and extend to the whole space. */
+	tlsf_ext_free(tlsf, blk2);
+	assert(tlsf_ext_extend(tlsf, blk, len) == 0);
+	assert(tlsf_unused_space(tlsf) == 0);
+	assert(tlsf_ext_trim(tlsf, blk, 1) == 0);
+	assert(tlsf_unused_space(tlsf) == len - 32);
+
+	/*
+	 * Extend over the small neighbour which was just freed (with the
+	 * deferred coalescing, it is on a quick list).
+	 */
+	blk2 = tlsf_ext_alloc_at(tlsf, addr + 32, 64);
+	assert(blk2 != NULL);
+	blk3 = tlsf_ext_alloc_at(tlsf, addr + 96, 32);
+	assert(blk3 != NULL);
+	tlsf_ext_free(tlsf, blk2);
+	assert(tlsf_ext_extend(tlsf, blk, 96) == 0);
+	assert(tlsf_ext_getaddr(blk, &blen) == addr);
+	assert(blen == 96);
+	tlsf_ext_free(tlsf, blk3);
+
+	tlsf_ext_free(tlsf, blk);
+	assert(tlsf_unused_space(tlsf) == len);
+	tlsf_destroy(tlsf);
+}
+
+static void
+ext_alloc_at_test(unsigned flags, bool defer)
+{
+	const uintptr_t base = 0x10000;
+	const size_t len = 64 * 1024;
+	tlsf_blk_t *blk1, *blk2, *blk3;
+	tlsf_t *tlsf;
+	size_t blen;
+
+	tlsf = tlsf_create2(base, len, 0, TLSF_EXT, flags);
+	assert(tlsf != NULL);
+	if (defer) {
+		assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 64) == 0);
+	}
+
+	/* Claim a range in the middle; it gets rounded to the MBS. */
+	blk1 = tlsf_ext_alloc_at(tlsf, base + 1000, 100);
+	assert(blk1 != NULL);
+	assert(tlsf_ext_getaddr(blk1, &blen) == base + 992);
+	assert(blen == 128);
+	assert(tlsf_unused_space(tlsf) == len - 128);
+
+	/* Overlapping and out-of-range requests must fail. */
+	assert(tlsf_ext_alloc_at(tlsf, base + 900, 100) == NULL);
+	assert(tlsf_ext_alloc_at(tlsf, base + 1100, 32) == NULL);
+	assert(tlsf_ext_alloc_at(tlsf, base - 32, 32) == NULL);
+	assert(tlsf_ext_alloc_at(tlsf, base + len - 32, 64) == NULL);
+
+	/* Free and claim the range again (it may be on a quick list). */
+	tlsf_ext_free(tlsf, blk1);
+	blk1 = tlsf_ext_alloc_at(tlsf, base + 1000, 100);
+	assert(blk1 != NULL);
+	assert(tlsf_ext_getaddr(blk1, NULL) == base + 992);
+	assert(tlsf_unused_space(tlsf) == len - 128);
+
+	/* Adjacent ranges on both sides and at the edges. */
+	blk2 = tlsf_ext_alloc_at(tlsf, base + 992 - 64, 64);
+	assert(blk2 != NULL);
+	blk3 = tlsf_ext_alloc_at(tlsf, base + len - 32, 32);
+	assert(blk3 != NULL);
+	assert(tlsf_unused_space(tlsf) == len - 128 - 64 - 32);
+
+	tlsf_ext_free(tlsf, blk1);
+	tlsf_ext_free(tlsf, blk2);
+	tlsf_ext_free(tlsf, blk3);
+	assert(tlsf_unused_space(tlsf) == len);
+
+	/* Everything must have been merged back. */
+	blk1 = tlsf_ext_alloc_at(tlsf, base, len);
+	assert(blk1 != NULL);
+	tlsf_ext_free(tlsf, blk1);
+	tlsf_destroy(tlsf);
+}
+
+static void
+ext_addridx_test(void)
+{
+	const uintptr_t base = 0x100000;
+	const size_t len = 1024 * 1024;
+	const unsigned maxitems = 1024;
+	uintptr_t addrs[maxitems];
+	unsigned n = 0;
+	tlsf_t *tlsf;
+
+	tlsf = tlsf_create2(base, len, 0, TLSF_EXT, TLSF_ADDRIDX);
+	assert(tlsf != NULL);
+
+	while (n < maxitems) {
+		tlsf_blk_t *blk;
+		size_t blen;
+
+		if ((blk = tlsf_ext_alloc(tlsf, random() % 4096 + 1)) == NULL)
+			break;
+		addrs[n++] = tlsf_ext_getaddr(blk, &blen);
+
+		/* Lookup by the start and the last unit of the block. */
+		assert(tlsf_ext_lookup(tlsf, addrs[n - 1]) == blk);
+		assert(tlsf_ext_lookup(tlsf, addrs[n - 1] + blen - 1) == blk);
+	}
+	assert(tlsf_ext_lookup(tlsf, base - 1) == NULL);
+	assert(tlsf_ext_lookup(tlsf, base + len) == NULL);
+
+	/* Free every other block by the address; check the lookups. */
+	for (unsigned i = 0; i < n; i += 2) {
+		assert(tlsf_ext_free_addr(tlsf, addrs[i] + 1) == -1);
+		assert(tlsf_ext_free_addr(tlsf, addrs[i]) == 0);
+		assert(tlsf_ext_lookup(tlsf, addrs[i]) == NULL);
+		assert(tlsf_ext_free_addr(tlsf, addrs[i]) == -1);
+	}
+	for (unsigned i = 1; i < n; i += 2) {
+		assert(tlsf_ext_lookup(tlsf, addrs[i]) != NULL);
+		assert(tlsf_ext_free_addr(tlsf, addrs[i]) == 0);
+	}
+	assert(tlsf_unused_space(tlsf) == len);
+	tlsf_destroy(tlsf);
+}
+
+static void
+int_lookup_test(unsigned flags)
+{
+	const size_t len = 1024 * 1024;
+	const unsigned maxitems = 1024;
+	size_t lens[maxitems];
+	uint8_t *space, *p[maxitems];
+	unsigned n = 0;
+	tlsf_t *tlsf;
+
+	space = malloc(len);
+	assert(space != NULL);
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, TLSF_INT, flags);
+	assert(tlsf != NULL);
+
+	while (n < maxitems) {
+		lens[n] = random() % 2048 + 1;
+		if ((p[n] = tlsf_alloc(tlsf, lens[n])) == NULL)
+			break;
+		n++;
+	}
+	assert(tlsf_lookup(tlsf, space - 1) == NULL);
+	assert(tlsf_lookup(tlsf, space + len) == NULL);
+
+	/* Interior pointers must resolve to the start of the allocation. */
+	for (unsigned i = 0; i < n; i++) {
+		assert(tlsf_lookup(tlsf, p[i]) == p[i]);
+		assert(tlsf_lookup(tlsf, p[i] + lens[i] / 2) == p[i]);
+		assert(tlsf_lookup(tlsf, p[i] + lens[i] - 1) == p[i]);
+		assert(tlsf_lookup(tlsf, p[i] - 1) == NULL);
+	}
+
+	/* Free every other allocation; freed space must not resolve. */
+	for (unsigned i = 0; i < n; i += 2) {
+		tlsf_free(tlsf, p[i]);
+	}
+	for (unsigned i = 0; i < n; i++) {
+		void *ptr = tlsf_lookup(tlsf, p[i] + lens[i] - 1);
+		assert(ptr == ((i & 1) ? p[i] : NULL));
+	}
+	for (unsigned i = 1; i < n; i += 2) {
+		tlsf_free(tlsf, p[i]);
+	}
+	assert(tlsf_lookup(tlsf, space + len / 2) == NULL);
+
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+hybrid_test(void)
+{
+	const size_t pgsize = 4096, npages = 16, len = npages * pgsize;
+	uint8_t *space, *p[npages];
+	tlsf_blk_t *blk;
+	tlsf_t *tlsf;
+
+	if (posix_memalign((void **)&space, pgsize, len) != 0) {
+		err(EXIT_FAILURE, "posix_memalign");
+	}
+	tlsf = tlsf_create((uintptr_t)space, len, pgsize, TLSF_HYBRID);
+	assert(tlsf != NULL);
+	assert(tlsf_unused_space(tlsf) == len);
+
+	/* The pages are packed exactly: no header in front of them. */
+	for (unsigned i = 0; i < npages; i++) {
+		p[i] = tlsf_alloc(tlsf, pgsize);
+		assert(p[i] == space + i * pgsize);
+		memset(p[i], i, pgsize);
+	}
+	assert(tlsf_unused_space(tlsf) == 0);
+	assert(tlsf_alloc(tlsf, 1) == NULL);
+
+	/* Interior pointers; the blocks are also the TLSF-EXT ones. */
+	for (unsigned i = 0; i < npages; i++) {
+		blk = tlsf_ext_lookup(tlsf, (uintptr_t)p[i] + 100);
+		assert(tlsf_lookup(tlsf, p[i] + pgsize - 1) == p[i]);
+		assert(tlsf_ext_getaddr(blk, NULL) == (uintptr_t)p[i]);
+	}
+
+	/* Free in the mixed order; the space must merge back. */
+	for (unsigned i = 0; i < npages; i += 2) {
+		tlsf_free(tlsf, p[i]);
+	}
+	assert(tlsf_lookup(tlsf, p[0]) == NULL);
+	p[0] = tlsf_alloc(tlsf, 2 * pgsize);
+	assert(p[0] == NULL);
+	for (unsigned i = 1; i < npages; i += 2) {
+		assert(p[i][0] == i);
+		tlsf_free(tlsf, p[i]);
+	}
+	assert(tlsf_unused_space(tlsf) == len);
+	assert(tlsf_alloc(tlsf, len) == space);
+
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+cblk_test(void)
+{
+	const size_t len = 64 * 1024;
+	uint8_t *space, *p[3];
+	tlsf_t *tlsf;
+
+	space = malloc(len);
+	assert(space != NULL);
+
+	/* The compact headers cannot represent 4 GB. */
+	tlsf = tlsf_create2((uintptr_t)space, (size_t)1 << 32, 0,
+	    TLSF_INT, TLSF_COMPACT);
+	assert(tlsf == NULL);
+
+	/*
+	 * The header takes 8 bytes: the consecutive blocks are the
+	 * (MBS-aligned) allocation plus 8 bytes apart.
+	 */
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, TLSF_INT, TLSF_COMPACT);
+	assert(tlsf != NULL);
+	assert(tlsf_unused_space(tlsf) == len - 8);
+
+	for (unsigned i = 0; i < __arraycount(p); i++) {
+		p[i] = tlsf_alloc(tlsf, 32);
+		assert(p[i] != NULL);
+		assert(((uintptr_t)p[i] & 7) == 0);
+		memset(p[i], 0xa5, 32);
+	}
+	assert(p[1] == p[0] + 32 + 8);
+	assert(p[2] == p[1] + 32 + 8);
+
+	/* Merging reclaims the headers. */
+	tlsf_free(tlsf, p[1]);
+	tlsf_free(tlsf, p[0]);
+	tlsf_free(tlsf, p[2]);
+	assert(tlsf_unused_space(tlsf) == len - 8);
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+compact_test(unsigned flags, bool defer)
+{
+	const size_t len = 1024 * 1024;
+	const unsigned maxitems = 2048;
+	tlsf_handle_t h[maxitems];
+	size_t lens[maxitems], unused;
+	unsigned n = 0, steps = 0;
+	uint8_t *space, *ptr = NULL;
+	tlsf_t *tlsf;
+
+	space = malloc(len);
+	assert(space != NULL);
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, TLSF_INT, flags);
+	assert(tlsf != NULL);
+	if (defer) {
+		/* The freed blocks stay on the quick lists. */
+		assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, maxitems) == 0);
+	}
+
+	/* Fill the space with relocatable blocks and a pinned block. */
+	while (n < maxitems) {
+		lens[n] = random() % 1024 + 1;
+		if ((h[n] = tlsf_handle_alloc(tlsf, lens[n])) == 0)
+			break;
+		memset(tlsf_handle_ptr(tlsf, h[n]), n & 0xff, lens[n]);
+		if (n == maxitems / 4) {
+			ptr = tlsf_alloc(tlsf, 100);
+			assert(ptr != NULL);
+		}
+		n++;
+	}
+	assert(n > maxitems / 4 && ptr != NULL);
+
+	/* Fragment the space: free every other block. */
+	for (unsigned i = 0; i < n; i += 2) {
+		tlsf_handle_free(tlsf, h[i]);
+		h[i] = 0;
+	}
+	unused = tlsf_unused_space(tlsf);
+	assert(tlsf_avail_space(tlsf) < unused / 2);
+
+	/* Compact in small steps; the data must be preserved. */
+	while (tlsf_compact(tlsf, 4096)) {
+		steps++;
+	}
+	assert(steps > 1);
+
+	/* Note: merging reclaims the block headers. */
+	assert(tlsf_unused_space(tlsf) >= unused);
+	assert(tlsf_avail_space(tlsf) > unused / 2);
+
+	for (unsigned i = 1; i < n; i += 2) {
+		uint8_t *data = tlsf_handle_ptr(tlsf, h[i]);
+
+		for (unsigned j = 0; j < lens[i]; j++) {
+			assert(data[j] == (i & 0xff));
+		}
+		assert(tlsf_lookup(tlsf, data + lens[i] - 1) == data);
+		tlsf_handle_free(tlsf, h[i]);
+	}
+
+	/* The handles are reused. */
+	h[0] = tlsf_handle_alloc(tlsf, 1);
+	assert(h[0] != 0);
+	tlsf_handle_free(tlsf, h[0]);
+
+	tlsf_free(tlsf, ptr);
+	if (defer) {
+		/* Coalesce the deferred blocks, so a step covers all. */
+		assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 0) == 0);
+	}
+	assert(tlsf_compact(tlsf, len) == 0);
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+/*
+ * handle_ext_test: the relocatable blocks are not supported with the
+ * external block headers.
+ */
+static void
+handle_ext_test(tlsf_mode_t mode)
+{
+	const size_t len = 64 * 1024;
+	void *space = malloc(len);
+	tlsf_t *tlsf;
+	size_t unused;
+
+	tlsf = tlsf_create((uintptr_t)space, len, 0, mode);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+
+	assert(tlsf_handle_alloc(tlsf, 100) == 0);
+	assert(tlsf_compact(tlsf, len) == 0);
+	assert(tlsf_unused_space(tlsf) == unused);
+
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static int
+defrag_move(void *arg, uintptr_t from, uintptr_t to, size_t len)
+{
+	uint8_t *space = arg;
+
+	memmove(space + to, space + from, len);
+	return 0;
+}
+
+static int
+defrag_move_fail(void *arg, uintptr_t from, uintptr_t to, size_t len)
+{
+	(void)arg; (void)from; (void)to; (void)len;
+	return -1;
+}
+
+/*
+ * ext_defrag_test: fragment the space and defragment it.  Returns the
+ * resulting available space, which must not depend on the deferred
+ * coalescing (the old locations are merged anyway).  The sizes are from
+ * a fixed seed, so both runs get the same sequence.
+ */
+static size_t
+ext_defrag_test(unsigned flags, bool defer)
+{
+	const size_t len = 1024 * 1024;
+	const unsigned maxitems = 4096;
+	tlsf_blk_t *blks[maxitems];
+	size_t unused, avail;
+	unsigned n = 0, steps = 0, seed = 1;
+	uint8_t *space;
+	tlsf_t *tlsf;
+	int ret;
+
+	/* Simulate the device using the memory. */
+	space = malloc(len);
+	assert(space != NULL);
+	tlsf = tlsf_create2(0, len, 0, TLSF_EXT, flags);
+	assert(tlsf != NULL);
+	if (defer) {
+		assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 16) == 0);
+	}
+
+	while (n < maxitems) {
+		uintptr_t addr;
+		size_t blen;
+
+		if ((blks[n] = tlsf_ext_alloc(tlsf, rand_r(&seed) % 512 + 1)) == NULL)
+			break;
+		addr = tlsf_ext_getaddr(blks[n], &blen);
+		memset(space + addr, n & 0xff, blen);
+		n++;
+	}
+
+	/* Fragment the space. */
+	for (unsigned i = 0; i < n; i += 2) {
+		tlsf_ext_free(tlsf, blks[i]);
+		blks[i] = NULL;
+	}
+	unused = tlsf_unused_space(tlsf);
+	avail = tlsf_avail_space(tlsf);
+
+	/* A failing move must not change anything. */
+	ret = tlsf_ext_defrag(tlsf, len, defrag_move_fail, NULL);
+	assert(ret == -1);
+	assert(tlsf_unused_space(tlsf) == unused);
+
+	/* Run a few passes. */
+	for (unsigned pass = 0; pass < 4; pass++) {
+		while ((ret = tlsf_ext_defrag(tlsf, 4096, defrag_move, space)))
+			steps++;
+	}
+	assert(steps > 0);
+	assert(tlsf_unused_space(tlsf) == unused);
+	assert(tlsf_avail_space(tlsf) > avail);
+	avail = tlsf_avail_space(tlsf);
+
+	/* The data must have been moved together with the blocks. */
+	for (unsigned i = 1; i < n; i += 2) {
+		uintptr_t addr;
+		size_t blen;
+
+		addr = tlsf_ext_getaddr(blks[i], &blen);
+		for (unsigned j = 0; j < blen; j++) {
+			assert(space[addr + j] == (i & 0xff));
+		}
+		tlsf_ext_free(tlsf, blks[i]);
+	}
+	assert(tlsf_unused_space(tlsf) == len);
+
+	tlsf_destroy(tlsf);
+	free(space);
+	return avail;
+}
+
+static void
+ext_defrag_pair(unsigned flags)
+{
+	const size_t avail = ext_defrag_test(flags, false);
+
+	assert(ext_defrag_test(flags, true) == avail);
+}
+
+static void
+goodfit_test(void)
+{
+	const size_t len = 64 * 1024;
+	tlsf_blk_t *blk, *sep, *blk2;
+	uintptr_t addr;
+	tlsf_t *tlsf;
+
+	for (unsigned goodfit = 0; goodfit < 2; goodfit++) {
+		tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+		assert(tlsf != NULL);
+		assert(tlsf_setopt(tlsf, TLSF_OPT_GOODFIT, goodfit * 4) == 0);
+
+		/*
+		 * Make a free block of exactly 8224 bytes: it is in the
+		 * class below the one the request is rounded up to.
+		 */
+		blk = tlsf_ext_alloc(tlsf, 8224);
+		assert(blk != NULL);
+		addr = tlsf_ext_getaddr(blk, NULL);
+		sep = tlsf_ext_alloc(tlsf, 32);
+		assert(sep != NULL);
+		tlsf_ext_free(tlsf, blk);
+
+		/* Only the good-fit policy takes the exact fit. */
+		blk2 = tlsf_ext_alloc(tlsf, 8224);
+		assert(blk2 != NULL);
+		assert((tlsf_ext_getaddr(blk2, NULL) == addr) == (goodfit != 0));
+
+		tlsf_ext_free(tlsf, blk2);
+		tlsf_ext_free(tlsf, sep);
+		assert(tlsf_unused_space(tlsf) == len);
+		tlsf_destroy(tlsf);
+	}
+}
+
+static void
+order_test(tlsf_mode_t mode)
+{
+	static const unsigned free_order[] = { 2, 0, 1 };
+	static const unsigned expected[] = {
+		[TLSF_ORDER_LIFO] = 1,
+		[TLSF_ORDER_FIFO] = 2,
+		[TLSF_ORDER_ADDR] = 0,
+	};
+	const size_t len = 64 * 1024;
+	void *space = malloc(len);
+
+	assert(space != NULL);
+	for (unsigned order = 0; order < __arraycount(expected); order++) {
+		void *p[3], *sep[3];
+		uintptr_t addr[3];
+		tlsf_t *tlsf;
+
+		tlsf = tlsf_create((uintptr_t)space, len, 0, mode);
+		assert(tlsf != NULL);
+		assert(tlsf_setopt(tlsf, TLSF_OPT_ORDER, order) == 0);
+
+		/*
+		 * Three free blocks of the same size class, with separators
+		 * so they do not merge, freed in a non-address order.
+		 */
+		for (unsigned i = 0; i < 3; i++) {
+			p[i] = (mode == TLSF_EXT) ?
+			    (void *)tlsf_ext_alloc(tlsf, 1024) :
+			    tlsf_alloc(tlsf, 1024);
+			sep[i] = (mode == TLSF_EXT) ?
+			    (void *)tlsf_ext_alloc(tlsf, 32) :
+			    tlsf_alloc(tlsf, 32);
+			assert(p[i] != NULL && sep[i] != NULL);
+			addr[i] = (mode == TLSF_EXT) ?
+			    tlsf_ext_getaddr(p[i], NULL) : (uintptr_t)p[i];
+		}
+		for (unsigned i = 0; i < 3; i++) {
+			if (mode == TLSF_EXT) {
+				tlsf_ext_free(tlsf, p[free_order[i]]);
+			} else {
+				tlsf_free(tlsf, p[free_order[i]]);
+			}
+		}
+
+		/* The block reused first depends on the order. */
+		p[0] = (mode == TLSF_EXT) ?
+		    (void *)tlsf_ext_alloc(tlsf, 1024) :
+		    tlsf_alloc(tlsf, 1024);
+		assert(p[0] != NULL);
+		assert(((mode == TLSF_EXT) ?
+		    tlsf_ext_getaddr(p[0], NULL) : (uintptr_t)p[0]) ==
+		    addr[expected[order]]);
+
+		tlsf_destroy(tlsf);
+	}
+	free(space);
+}
+
+static void
+topdown_test(tlsf_mode_t mode)
+{
+	const size_t len = 64 * 1024;
+	uint8_t *space = malloc(len);
+	void *small, *large, *big;
+	const uintptr_t end = (uintptr_t)space + len;
+	uintptr_t a, b, c;
+	size_t bytesfree;
+	tlsf_t *tlsf;
+
+	assert(space != NULL);
+	tlsf = tlsf_create((uintptr_t)space, len, 0, mode);
+	assert(tlsf != NULL);
+	bytesfree = tlsf_unused_space(tlsf);
+	assert(tlsf_setopt(tlsf, TLSF_OPT_TOPDOWN, 8192) == 0);
+
+	/*
+	 * Short-lived small allocation comes from the low end, while the
+	 * long-lived and the large ones come from the high end.
+	 */
+	small = (mode == TLSF_EXT) ?
+	    (void *)tlsf_ext_alloc(tlsf, 100) : tlsf_alloc(tlsf, 100);
+	large = (mode == TLSF_EXT) ?
+	    (void *)tlsf_ext_alloc2(tlsf, 100, TLSF_LONGLIVED) :
+	    tlsf_alloc2(tlsf, 100, TLSF_LONGLIVED);
+	big = (mode == TLSF_EXT) ?
+	    (void *)tlsf_ext_alloc(tlsf, 8192) : tlsf_alloc(tlsf, 8192);
+	assert(small != NULL && large != NULL && big != NULL);
+
+	a = (mode == TLSF_EXT) ?
+	    tlsf_ext_getaddr(small, NULL) : (uintptr_t)small;
+	b = (mode == TLSF_EXT) ?
+	    tlsf_ext_getaddr(large, NULL) : (uintptr_t)large;
+	c = (mode == TLSF_EXT) ?
+	    tlsf_ext_getaddr(big, NULL) : (uintptr_t)big;
+	assert(a < (uintptr_t)space + 1024);
+	assert(b > end - 1024 && b + 100 <= end);
+	assert(c < b && c > end - 8192 - 1024);
+	memset((void *)c, 0, 8192);
+	memset((void *)b, 0, 100);
+
+	/* All the blocks are merged back. */
+	if (mode == TLSF_EXT) {
+		tlsf_ext_free(tlsf, large);
+		tlsf_ext_free(tlsf, small);
+		tlsf_ext_free(tlsf, big);
+	} else {
+		tlsf_free(tlsf, large);
+		tlsf_free(tlsf, small);
+		tlsf_free(tlsf, big);
+	}
+	assert(tlsf_unused_space(tlsf) == bytesfree);
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+victim_test(void)
+{
+	const size_t len = 64 * 1024;
+	tlsf_blk_t *blk, *sep, *blk2;
+	uintptr_t addr, sepaddr;
+	tlsf_t *tlsf;
+
+	for (unsigned victim = 0; victim < 2; victim++) {
+		tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+		assert(tlsf != NULL);
+		assert(tlsf_setopt(tlsf, TLSF_OPT_VICTIM, victim) == 0);
+
+		/*
+		 * Leave a free 1 KB block in the lists, while the remainder
+		 * of the last split follows the separator.
+		 */
+		blk = tlsf_ext_alloc(tlsf, 1024);
+		assert(blk != NULL);
+		addr = tlsf_ext_getaddr(blk, NULL);
+		sep = tlsf_ext_alloc(tlsf, 32);
+		assert(sep != NULL);
+		sepaddr = tlsf_ext_getaddr(sep, NULL);
+		tlsf_ext_free(tlsf, blk);
+		assert(tlsf_avail_space(tlsf) >= len / 2);
+
+		/*
+		 * The victim serves the next allocation, placing it next
+		 * to the previous one; otherwise, the 1 KB block is split.
+		 */
+		blk2 = tlsf_ext_alloc(tlsf, 100);
+		assert(blk2 != NULL);
+		assert(tlsf_ext_getaddr(blk2, NULL) ==
+		    (victim ? sepaddr + 32 : addr));
+
+		/* Freeing merges with the victim. */
+		tlsf_ext_free(tlsf, blk2);
+		tlsf_ext_free(tlsf, sep);
+		assert(tlsf_unused_space(tlsf) == len);
+		assert(tlsf_avail_space(tlsf) >= len / 2);
+
+		/* Disabling returns the victim to the lists. */
+		blk = tlsf_ext_alloc(tlsf, 100);
+		assert(tlsf_setopt(tlsf, TLSF_OPT_VICTIM, 0) == 0);
+		tlsf_ext_free(tlsf, blk);
+		assert(tlsf_unused_space(tlsf) == len);
+		tlsf_destroy(tlsf);
+	}
+}
+
+static void
+defer_test(void)
+{
+	const size_t len = 64 * 1024, nblks = len / 32;
+	tlsf_blk_t **blks, *blk;
+	size_t avail;
+	tlsf_t *tlsf;
+
+	blks = calloc(nblks, sizeof(tlsf_blk_t *));
+	assert(blks != NULL);
+
+	tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+	assert(tlsf != NULL);
+	avail = tlsf_avail_space(tlsf);
+	assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, nblks) == 0);
+	assert(tlsf_setopt(tlsf, TLSF_OPT_COALESCE, 2) == 0);
+
+	/*
+	 * Fill the whole space with the small blocks and free them:
+	 * they are deferred, i.e. not merged.
+	 */
+	for (unsigned i = 0; i < nblks; i++) {
+		blks[i] = tlsf_ext_alloc(tlsf, 32);
+		assert(blks[i] != NULL);
+	}
+	assert(tlsf_ext_alloc(tlsf, 32) == NULL);
+	for (unsigned i = 0; i < nblks; i++) {
+		tlsf_ext_free(tlsf, blks[i]);
+	}
+	assert(tlsf_unused_space(tlsf) == len);
+	assert(tlsf_avail_space(tlsf) == 0);
+
+	/* The quick list serves the same size. */
+	blk = tlsf_ext_alloc(tlsf, 32);
+	assert(blk != NULL);
+	tlsf_ext_free(tlsf, blk);
+
+	/* A miss coalesces at most two blocks per call. */
+	assert(tlsf_ext_alloc(tlsf, 1024) == NULL);
+	assert(tlsf_avail_space(tlsf) > 0);
+
+	/* No limit: all blocks get coalesced on a miss. */
+	assert(tlsf_setopt(tlsf, TLSF_OPT_COALESCE, 0) == 0);
+	blk = tlsf_ext_alloc(tlsf, 1024);
+	assert(blk != NULL);
+	tlsf_ext_free(tlsf, blk);
+
+	/* Disabling the deferred mode coalesces the remaining blocks. */
+	assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 0) == 0);
+	assert(tlsf_unused_space(tlsf) == len);
+	assert(tlsf_avail_space(tlsf) == avail);
+
+	tlsf_destroy(tlsf);
+	free(blks);
+}
+
+static bool
+density_reuse(tlsf_t *tlsf, size_t size)
+{
+	tlsf_blk_t *blk, *sep, *blk2;
+	uintptr_t addr;
+	bool reused;
+
+	/*
+	 * Leave a free block of the given size and check whether the
+	 * allocation of the same size reuses it, i.e. whether the size
+	 * is on the boundary of the second-level class.
+	 */
+	blk = tlsf_ext_alloc(tlsf, size);
+	assert(blk != NULL);
+	addr = tlsf_ext_getaddr(blk, NULL);
+	sep = tlsf_ext_alloc(tlsf, 32);
+	assert(sep != NULL);
+	tlsf_ext_free(tlsf, blk);
+
+	blk2 = tlsf_ext_alloc(tlsf, size);
+	assert(blk2 != NULL);
+	reused = tlsf_ext_getaddr(blk2, NULL) == addr;
+	tlsf_ext_free(tlsf, blk2);
+	tlsf_ext_free(tlsf, sep);
+	return reused;
+}
+
+static void
+density_test(void)
+{
+	const size_t len = 1024 * 1024, size = 16384 + 256;
+	tlsf_blk_t *blks[64];
+	tlsf_t *tlsf;
+
+	tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+	assert(tlsf != NULL);
+
+	/* Invalid counts. */
+	assert(tlsf_setdensity(tlsf, size, 0) == -1);
+	assert(tlsf_setdensity(tlsf, size, 48) == -1);
+	assert(tlsf_setdensity(tlsf, size, 128) == -1);
+
+	/*
+	 * With 8 subdivisions, the class width is 2 KB; with 64, it is
+	 * 256 bytes, so the size is on the class boundary.
+	 */
+	assert(tlsf_setdensity(tlsf, size, 8) == 0);
+	assert(!density_reuse(tlsf, size));
+	assert(tlsf_setdensity(tlsf, size, 64) == 0);
+	assert(density_reuse(tlsf, size));
+	assert(tlsf_unused_space(tlsf) == len);
+
+	/* The free blocks are re-inserted. */
+	blks[0] = tlsf_ext_alloc(tlsf, size);
+	blks[1] = tlsf_ext_alloc(tlsf, 100);
+	tlsf_ext_free(tlsf, blks[0]);
+	assert(tlsf_setdensity(tlsf, size, 8) == 0);
+	blks[0] = tlsf_ext_alloc(tlsf, size);
+	assert(blks[0] != NULL);
+	tlsf_ext_free(tlsf, blks[0]);
+	tlsf_ext_free(tlsf, blks[1]);
+	assert(tlsf_unused_space(tlsf) == len);
+	tlsf_destroy(tlsf);
+
+	/*
+	 * Learn the density from the profile: most of the allocations
+	 * are of the given size.
+	 */
+	tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+	assert(tlsf != NULL);
+	assert(tlsf_setdensity(tlsf, size, 8) == 0);
+	assert(!density_reuse(tlsf, size));
+
+	assert(tlsf_setopt(tlsf, TLSF_OPT_PROFILE, 1) == 0);
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		blks[i] = tlsf_ext_alloc(tlsf, (i % 8) ? size : 100);
+		assert(blks[i] != NULL);
+	}
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		tlsf_ext_free(tlsf, blks[i]);
+	}
+	assert(tlsf_setopt(tlsf, TLSF_OPT_PROFILE, 0) == 0);
+	assert(density_reuse(tlsf, size));
+	assert(tlsf_unused_space(tlsf) == len);
+	tlsf_destroy(tlsf);
+}
+
+static void
+smallmap_test(void)
+{
+	const size_t len = 4096;
+	void *blks[4], *mem, *ptr;
+	size_t unused;
+	tlsf_t *tlsf;
+
+	/*
+	 * The map is sized only for the classes of the small space; it
+	 * grows if the density is increased, up to the maximum of all.
+	 */
+	tlsf = tlsf_create(0, len, 0, TLSF_EXT);
+	assert(tlsf != NULL);
+	assert(tlsf_setdensity(tlsf, 8192, 64) == -1);
+	for (size_t size = 64; size <= len; size *= 2) {
+		assert(tlsf_setdensity(tlsf, size, 64) == 0);
+	}
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		blks[i] = tlsf_ext_alloc(tlsf, 1000 - i * 100);
+		assert(blks[i] != NULL);
+	}
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		tlsf_ext_free(tlsf, blks[i]);
+	}
+	assert(tlsf_unused_space(tlsf) == len);
+	tlsf_destroy(tlsf);
+
+	/*
+	 * So are the first-level classes: the sizes beyond the space, or
+	 * rounding up past it, must not go beyond them.  The quick lists
+	 * are allocated once the deferred coalescing is enabled.
+	 */
+	mem = malloc(8128);
+	assert(mem != NULL);
+	tlsf = tlsf_create((uintptr_t)mem, 8128, 64, TLSF_INT);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+	assert(tlsf_alloc_inline(tlsf, 8100) == NULL);
+	assert(tlsf_alloc_inline(tlsf, 8129) == NULL);
+	assert(tlsf_alloc_const(tlsf, 8129) == NULL);
+	ptr = tlsf_alloc_const(tlsf, 32);
+	assert(ptr != NULL);
+	tlsf_free(tlsf, ptr);
+
+	assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 4) == 0);
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		blks[i] = tlsf_alloc(tlsf, 64);
+		assert(blks[i] != NULL);
+	}
+	for (unsigned i = 0; i < __arraycount(blks); i++) {
+		tlsf_free(tlsf, blks[i]);
+	}
+	tlsf_reset(tlsf);
+	assert(tlsf_unused_space(tlsf) == unused);
+	assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 0) == 0);
+	tlsf_destroy(tlsf);
+	free(mem);
+}
+
+static void
+inline_test(unsigned flags)
+{
+	const size_t len = 64 * 1024, nitems = 256;
+	uint8_t *space[2];
+	void *ptrs[2][nitems];
+	tlsf_t *tlsf[2];
+
+	/*
+	 * The inline fast path must make the same choices as the regular
+	 * allocation: run the same sequence on two spaces and compare the
+	 * offsets.  Then check the fallback to the regular path.
+	 */
+	for (unsigned t = 0; t < 2; t++) {
+		space[t] = malloc(len);
+		assert(space[t] != NULL);
+		tlsf[t] = tlsf_create2((uintptr_t)space[t], len, 0,
+		    TLSF_INT, flags);
+		assert(tlsf[t] != NULL);
+		memset(ptrs[t], 0, sizeof(ptrs[t]));
+	}
+	for (unsigned r = 0; r < 2; r++) {
+		if (r == 1) {
+			assert(tlsf_setopt(tlsf[0], TLSF_OPT_VICTIM, 1) == 0);
+			assert(tlsf_setopt(tlsf[1], TLSF_OPT_VICTIM, 1) == 0);
+		}
+		for (unsigned n = 0; n < nitems * 8; n++) {
+			const unsigned i = random() % nitems;
+			const size_t size = (random() % 512) + 1;
+
+			if (ptrs[0][i]) {
+				tlsf_free(tlsf[0], ptrs[0][i]);
+				tlsf_free_inline(tlsf[1], ptrs[1][i]);
+				ptrs[0][i] = ptrs[1][i] = NULL;
+				continue;
+			}
+			ptrs[0][i] = tlsf_alloc(tlsf[0], size);
+			ptrs[1][i] = tlsf_alloc_inline(tlsf[1], size);
+			assert((ptrs[0][i] == NULL) == (ptrs[1][i] == NULL));
+			if (ptrs[0][i] == NULL) {
+				continue;
+			}
+			assert((uint8_t *)ptrs[0][i] - space[0] ==
+			    (uint8_t *)ptrs[1][i] - space[1]);
+			memset(ptrs[1][i], 0xa5, size);
+			assert(tlsf_unused_space(tlsf[0]) ==
+			    tlsf_unused_space(tlsf[1]));
+		}
+	}
+	for (unsigned t = 0; t < 2; t++) {
+		for (unsigned i = 0; i < nitems; i++) {
+			if (ptrs[t][i])
+				tlsf_free_inline(tlsf[t], ptrs[t][i]);
+		}
+		assert(tlsf_setopt(tlsf[t], TLSF_OPT_VICTIM, 0) == 0);
+	}
+	assert(tlsf_unused_space(tlsf[0]) == tlsf_unused_space(tlsf[1]));
+	assert(tlsf_avail_space(tlsf[0]) == tlsf_avail_space(tlsf[1]));
+	for (unsigned t = 0; t < 2; t++) {
+		tlsf_destroy(tlsf[t]);
+		free(space[t]);
+	}
+}
+
+static void *
+const_alloc(tlsf_t *tlsf, unsigned n)
+{
+	struct obj { uint8_t buf[200]; };
+
+	switch (n % 4) {
+	case 0:
+		return tlsf_alloc_const(tlsf, 1);
+	case 1:
+		return tlsf_alloc_const(tlsf, sizeof(struct obj));
+	case 2:
+		return tlsf_alloc_const(tlsf, 1000);
+	default:
+		return tlsf_alloc_const(tlsf, 4096 + 1);
+	}
+}
+
+static void
+const_test(unsigned mbs)
+{
+	const size_t len = 64 * 1024, nitems = 128;
+	const size_t sizes[] = { 1, 200, 1000, 4096 + 1 };
+	void *ptrs[2][nitems];
+	uint8_t *space[2];
+	tlsf_t *tlsf[2];
+
+	/*
+	 * Same as inline_test(), but with the constant sizes, resolved to
+	 * the class at compile time.  A different MBS or density makes it
+	 * take the regular path.
+	 */
+	for (unsigned t = 0; t < 2; t++) {
+		space[t] = malloc(len);
+		assert(space[t] != NULL);
+		tlsf[t] = tlsf_create((uintptr_t)space[t], len, mbs, TLSF_INT);
+		assert(tlsf[t] != NULL);
+		memset(ptrs[t], 0, sizeof(ptrs[t]));
+	}
+	for (unsigned r = 0; r < 2; r++) {
+		if (r == 1) {
+			assert(tlsf_setdensity(tlsf[0], 1000, 8) == 0);
+			assert(tlsf_setdensity(tlsf[1], 1000, 8) == 0);
+		}
+		for (unsigned n = 0; n < nitems * 8; n++) {
+			const unsigned i = random() % nitems;
+			const unsigned k = random();
+
+			if (ptrs[0][i]) {
+				tlsf_free(tlsf[0], ptrs[0][i]);
+				tlsf_free_inline(tlsf[1], ptrs[1][i]);
+				ptrs[0][i] = ptrs[1][i] = NULL;
+				continue;
+			}
+			ptrs[0][i] = tlsf_alloc(tlsf[0], sizes[k % 4]);
+			ptrs[1][i] = const_alloc(tlsf[1], k);
+			assert((ptrs[0][i] == NULL) == (ptrs[1][i] == NULL));
+			if (ptrs[0][i] == NULL) {
+				continue;
+			}
+			assert((uint8_t *)ptrs[0][i] - space[0] ==
+			    (uint8_t *)ptrs[1][i] - space[1]);
+			memset(ptrs[1][i], 0xa5, sizes[k % 4]);
+		}
+	}
+	for (unsigned t = 0; t < 2; t++) {
+		for (unsigned i = 0; i < nitems; i++) {
+			if (ptrs[t][i])
+				tlsf_free(tlsf[t], ptrs[t][i]);
+		}
+	}
+	assert(tlsf_unused_space(tlsf[0]) == tlsf_unused_space(tlsf[1]));
+	assert(tlsf_avail_space(tlsf[0]) == tlsf_avail_space(tlsf[1]));
+	for (unsigned t = 0; t < 2; t++) {
+		tlsf_destroy(tlsf[t]);
+		free(space[t]);
+	}
+}
+
+/*
+ * addrmap_clear_test: clear the map, with and without keeping the path
+ * of the zero key, and reuse it.
+ */
+static void
+addrmap_clear_test(void)
+{
+	const uintptr_t key = (uintptr_t)1 << 20;
+	addrmap_t *map = addrmap_create(key << 4);
+	int val;
+
+	assert(map != NULL);
+	for (unsigned i = 0; i < 4; i++) {
+		assert(addrmap_set(map, key, &val) == 0);
+		assert(addrmap_set(map, key << 3, &val) == 0);
+		if (i & 1) {
+			assert(addrmap_clear(map, &val) == 0);
+			assert(addrmap_get(map, 0) == &val);
+			assert(addrmap_get_le(map, key << 4) == &val);
+		} else {
+			assert(addrmap_clear(map, NULL) == 0);
+			assert(addrmap_get(map, 0) == NULL);
+			assert(addrmap_get_le(map, key << 4) == NULL);
+		}
+		assert(addrmap_get(map, key) == NULL);
+		assert(addrmap_get_le(map, key - 1) == ((i & 1) ? &val : NULL));
+	}
+	addrmap_destroy(map);
+}
+
+static void
+reset_test(tlsf_mode_t mode, unsigned flags)
+{
+	const size_t len = 64 * 1024;
+	const bool ext = (mode == TLSF_EXT);
+	void *space = ext ? NULL : malloc(len);
+	uintptr_t base = ext ? 0x1000 : (uintptr_t)space;
+	size_t unused, avail;
+	tlsf_blk_t *blk;
+	uintptr_t first = 0;
+	tlsf_t *tlsf;
+
+	tlsf = tlsf_create2(base, len, 0, mode, flags);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+	avail = tlsf_avail_space(tlsf);
+
+	for (unsigned round = 0; round < 3; round++) {
+		/*
+		 * Fill the space with the blocks of various sizes, free
+		 * some of them (deferring the coalescing in the last round)
+		 * and release the rest at once.
+		 */
+		if (round == 2) {
+			assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 16) == 0);
+		}
+		for (unsigned i = 0;; i++) {
+			const size_t size = 16 + (i % 13) * 40;
+			uintptr_t addr;
+
+			if (ext) {
+				if ((blk = tlsf_ext_alloc(tlsf, size)) == NULL)
+					break;
+				addr = tlsf_ext_getaddr(blk, NULL);
+				if (i % 3 == 0)
+					tlsf_ext_free(tlsf, blk);
+			} else {
+				void *ptr;
+
+				if ((ptr = tlsf_alloc(tlsf, size)) == NULL)
+					break;
+				addr = (uintptr_t)ptr;
+				if (i % 3 == 0)
+					tlsf_free(tlsf, ptr);
+			}
+			if (i == 0) {
+				/* The same first block in every round. */
+				assert(round == 0 || first == addr);
+				first = addr;
+			}
+		}
+		if (mode == TLSF_INT) {
+			/* Grow the handle table, if there is any space. */
+			(void)tlsf_handle_alloc(tlsf, 100);
+		}
+		tlsf_reset(tlsf);
+		assert(tlsf_unused_space(tlsf) == unused);
+		assert(tlsf_avail_space(tlsf) == avail);
+
+		/* The handles are released too. */
+		if (round == 2) {
+			assert(tlsf_setopt(tlsf, TLSF_OPT_DEFER, 0) == 0);
+		}
+		if (mode == TLSF_INT) {
+			tlsf_handle_t h = tlsf_handle_alloc(tlsf, 100);
+
+			assert(h == 1);
+			tlsf_handle_free(tlsf, h);
+			assert(tlsf_unused_space(tlsf) == unused);
+		}
+	}
+	if (ext && (flags & TLSF_ADDRIDX)) {
+		blk = tlsf_ext_alloc(tlsf, 100);
+		assert(tlsf_ext_lookup(tlsf, base + 50) == blk);
+		tlsf_ext_free(tlsf, blk);
+	}
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+/*
+ * calloc_test: the space is declared zero-filled, while it is not, so it
+ * can be seen whether tlsf_calloc() skips the known-zero blocks.
+ */
+static void
+calloc_test(tlsf_mode_t mode, unsigned flags)
+{
+	const size_t len = 4 * 1024 * 1024, links = 2 * sizeof(void *);
+	const bool skip = !(flags & TLSF_COMPACT);
+	const size_t skipped = mode == TLSF_INT ? links : 0;
+	uint8_t *space = malloc(len), *a, *b, *c, *d;
+	tlsf_t *tlsf;
+
+	assert(space != NULL);
+	memset(space, 0xa5, len);
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, mode, flags | TLSF_ZEROED);
+	assert(tlsf != NULL);
+
+	/*
+	 * Fresh blocks: only the list entries of TLSF-INT are zeroed.
+	 * The remainders of the split stay known-zero.
+	 */
+	a = tlsf_calloc(tlsf, 10, 10);
+	b = tlsf_calloc(tlsf, 1, 1000);
+	assert(a != NULL && b != NULL);
+	for (unsigned i = 0; i < 1000; i++) {
+		const unsigned v = (skip && i >= skipped) ? 0xa5 : 0;
+
+		assert(i >= 100 || a[i] == v);
+		assert(b[i] == v);
+	}
+
+	/* The released (dirty) block is zeroed entirely. */
+	memset(a, 0xff, 100);
+	tlsf_free(tlsf, a);
+	c = tlsf_calloc(tlsf, 100, 1);
+	assert(c == a);
+	for (unsigned i = 0; i < 100; i++) {
+		assert(c[i] == 0);
+	}
+
+	/* A merge with the dirty block is dirty. */
+	tlsf_free(tlsf, c);
+	tlsf_free(tlsf, b);
+	d = tlsf_calloc(tlsf, 1, 3000);
+	assert(d == a);
+	for (unsigned i = 0; i < 3000; i++) {
+		assert(d[i] == 0);
+	}
+
+	/* The regular allocation does not keep the flag. */
+	memset(d, 0xff, 3000);
+	tlsf_free(tlsf, d);
+	a = tlsf_alloc(tlsf, 100);
+	memset(a, 0xff, 100);
+	tlsf_free(tlsf, a);
+	a = tlsf_calloc(tlsf, 1, 100);
+	for (unsigned i = 0; i < 100; i++) {
+		assert(a[i] == 0);
+	}
+	tlsf_free(tlsf, a);
+
+	/* Large ranges (non-temporal stores). */
+	a = tlsf_calloc(tlsf, 1, len / 2);
+	assert(a != NULL);
+	memset(a + 1, 0xff, len / 2 - 3);
+	tlsf_free(tlsf, a);
+	a = tlsf_calloc(tlsf, 1, len / 2 - 1);
+	for (size_t i = 0; i < len / 2 - 1; i++) {
+		assert(a[i] == 0);
+	}
+	tlsf_free(tlsf, a);
+
+	assert(tlsf_calloc(tlsf, SIZE_MAX / 2, 4) == NULL);
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+region_test(tlsf_mode_t mode, unsigned flags)
+{
+	const size_t len = 1024 * 1024;
+	void *space = malloc(len);
+	tlsf_region_t *region, *inner;
+	size_t unused, avail;
+	uint8_t *ptrs[1000];
+	tlsf_t *tlsf;
+	void *ptr;
+
+	assert(space != NULL);
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, mode, flags);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+	avail = tlsf_avail_space(tlsf);
+
+	/*
+	 * Allocate more than the chunk, so the region overflows; the
+	 * objects must not overlap and must be aligned.
+	 */
+	region = tlsf_region_begin(tlsf, 4096);
+	assert(region != NULL);
+	for (unsigned i = 0; i < __arraycount(ptrs); i++) {
+		const size_t size = 1 + i % 200;
+
+		ptrs[i] = (i & 1) ? tlsf_region_alloc(region, size) :
+		    tlsf_region_alloc_inline(region, size);
+		assert(ptrs[i] != NULL);
+		assert(((uintptr_t)ptrs[i] & (TLSF_REGION_ALIGN - 1)) == 0);
+		memset(ptrs[i], (int)i, size);
+	}
+	for (unsigned i = 0; i < __arraycount(ptrs); i++) {
+		const size_t size = 1 + i % 200;
+
+		assert(ptrs[i][0] == (uint8_t)i);
+		assert(ptrs[i][size - 1] == (uint8_t)i);
+	}
+
+	/* The large allocation does not take the current chunk. */
+	ptr = tlsf_region_alloc(region, 1);
+	assert(tlsf_region_alloc(region, 64 * 1024) != NULL);
+	assert((uintptr_t)tlsf_region_alloc(region, 1) ==
+	    (uintptr_t)ptr + TLSF_REGION_ALIGN);
+
+	/* The regions nest. */
+	inner = tlsf_region_begin(tlsf, 1024);
+	assert(inner != NULL && tlsf_region_alloc(inner, 100) != NULL);
+	tlsf_region_end(inner);
+
+	assert(tlsf_region_alloc(region, len) == NULL);
+	assert(tlsf_region_alloc(region, SIZE_MAX) == NULL);
+	assert(tlsf_region_alloc_inline(region, SIZE_MAX - 1) == NULL);
+	assert(tlsf_region_alloc(region, 0) != NULL);
+
+	tlsf_region_end(region);
+	assert(tlsf_unused_space(tlsf) == unused);
+	assert(tlsf_avail_space(tlsf) == avail);
+
+	/* The chunk which does not fit. */
+	assert(tlsf_region_begin(tlsf, len) == NULL);
+	assert(tlsf_region_begin(tlsf, 0) == NULL);
+
+	tlsf_destroy(tlsf);
+	free(space);
+
+	/* Not supported with TLSF-EXT. */
+	tlsf = tlsf_create(0x1000, len, 0, TLSF_EXT);
+	assert(tlsf_region_begin(tlsf, 4096) == NULL);
+	tlsf_destroy(tlsf);
+}
+
+/*
+ * ring_test: stream the records through the ring, freeing them mostly in
+ * order, while a long-lived record is holding the tail for a while.
+ */
+static void
+ring_test(tlsf_mode_t mode, unsigned flags)
+{
+	const size_t len = 1024 * 1024, rsize = 4096;
+	void *space = malloc(len);
+	uint8_t *recs[64], *pinned;
+	unsigned head = 0, tail = 0;
+	size_t unused, avail, rused;
+	unsigned seed = 1;
+	tlsf_ring_t *ring;
+	tlsf_t *tlsf;
+	bool fallback = false;
+
+	assert(space != NULL);
+	tlsf = tlsf_create2((uintptr_t)space, len, 0, mode, flags);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+	avail = tlsf_avail_space(tlsf);
+
+	ring = tlsf_ring_create(tlsf, rsize);
+	assert(ring != NULL);
+	rused = unused - tlsf_unused_space(tlsf);
+
+	/*
+	 * The FIFO stream: at most 16 records of up to 100 bytes are
+	 * outstanding, so they always fit the ring.  Every 7th record is
+	 * freed out of order, i.e. before its predecessor.
+	 */
+	for (unsigned i = 0; i < 100000; i++) {
+		const size_t size = 1 + rand_r(&seed) % 100;
+		uint8_t *rec;
+
+		rec = recs[head++ % 64] = tlsf_ring_alloc(ring, size);
+		assert(rec != NULL);
+		assert(((uintptr_t)rec & 15) == 0);
+		memset(rec, (int)((uintptr_t)rec >> 4), size);
+		assert(tlsf_unused_space(tlsf) == unused - rused);
+
+		if (head - tail < 16)
+			continue;
+		if (i % 7 == 0) {
+			uint8_t *tmp = recs[(tail + 1) % 64];
+
+			recs[(tail + 1) % 64] = recs[tail % 64];
+			recs[tail % 64] = tmp;
+		}
+		rec = recs[tail++ % 64];
+		assert(rec[0] == (uint8_t)((uintptr_t)rec >> 4));
+		tlsf_ring_free(ring, rec);
+	}
+	while (tail != head) {
+		tlsf_ring_free(ring, recs[tail++ % 64]);
+	}
+
+	/*
+	 * The long-lived record holds the tail: once the ring is full,
+	 * the records come from the space.
+	 */
+	head = tail = 0;
+	pinned = tlsf_ring_alloc(ring, 100);
+	for (unsigned i = 0; i < 1000; i++) {
+		uint8_t *rec = tlsf_ring_alloc(ring, 200);
+
+		assert(rec != NULL);
+		memset(rec, 0xa5, 200);
+		fallback |= tlsf_unused_space(tlsf) != unused - rused;
+		recs[head++ % 64] = rec;
+		if (head - tail == 16) {
+			tlsf_ring_free(ring, recs[tail++ % 64]);
+		}
+		if (i == 500) {
+			assert(fallback);
+			tlsf_ring_free(ring, pinned);
+		}
+	}
+	while (tail != head) {
+		tlsf_ring_free(ring, recs[tail++ % 64]);
+	}
+	assert(tlsf_unused_space(tlsf) == unused - rused);
+
+	/* The record taking the whole ring. */
+	pinned = tlsf_ring_alloc(ring, rsize - sizeof(size_t));
+	assert(pinned != NULL);
+	assert(tlsf_unused_space(tlsf) == unused - rused);
+	tlsf_ring_free(ring, pinned);
+	assert(tlsf_ring_alloc(ring, SIZE_MAX) == NULL);
+
+	tlsf_ring_destroy(ring);
+	assert(tlsf_unused_space(tlsf) == unused);
+	assert(tlsf_avail_space(tlsf) == avail);
+	assert(tlsf_ring_create(tlsf, len) == NULL);
+
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+/*
+ * zero_size_test: the zero size is not allocated, nor is the size which
+ * would wrap around when rounded up; also with the allocation profile.
+ */
+static void
+zero_size_test(tlsf_mode_t mode, unsigned flags)
+{
+	const size_t len = 64 * 1024;
+	const bool ext = (mode == TLSF_EXT);
+	void *space = ext ? NULL : malloc(len);
+	uintptr_t base = ext ? 0x1000 : (uintptr_t)space;
+	size_t unused;
+	tlsf_t *tlsf;
+
+	tlsf = tlsf_create2(base, len, 0, mode, flags);
+	assert(tlsf != NULL);
+	unused = tlsf_unused_space(tlsf);
+
+	for (unsigned i = 0; i < 2; i++) {
+		assert(tlsf_ext_alloc(tlsf, 0) == NULL);
+		assert(tlsf_ext_alloc(tlsf, SIZE_MAX) == NULL);
+		if (!ext) {
+			assert(tlsf_alloc(tlsf, 0) == NULL);
+			assert(tlsf_alloc(tlsf, SIZE_MAX - 1) == NULL);
+			assert(tlsf_calloc(tlsf, 0, 8) == NULL);
+			assert(tlsf_calloc(tlsf, 8, 0) == NULL);
+			assert(tlsf_alloc_inline(tlsf, 0) == NULL);
+			assert(tlsf_alloc_inline(tlsf, SIZE_MAX) == NULL);
+		}
+		assert(tlsf_unused_space(tlsf) == unused);
+		assert(tlsf_setopt(tlsf, TLSF_OPT_PROFILE, 1) == 0);
+	}
+	tlsf_destroy(tlsf);
+	free(space);
+}
+
+static void
+random_test(const size_t spacelen, const size_t cap, tlsf_mode_t mode,
+    unsigned flags)
 {
 	const size_t maxitems = spacelen;
 	size_t len, bytesfree;
@@ -69,7 +1523,7 @@ random_test(const size_t spacelen, const size_t cap, tlsf_mode_t mode)
 		err(EXIT_FAILURE, "malloc");
 	}
 
-	tlsf = tlsf_create((uintptr_t)space, spacelen, 0, mode);
+	tlsf = tlsf_create2((uintptr_t)space, spacelen, 0, mode, flags);
 	assert(tlsf != NULL);
 	bytesfree = tlsf_unused_space(tlsf);
 
@@ -126,7 +1580,7 @@ random_test(const size_t spacelen, const size_t cap, tlsf_mode_t mode)
 }
 
 static void
-random_sizes_test(tlsf_mode_t mode)
+random_sizes_test(tlsf_mode_t mode, unsigned flags)
 {
 	const size_t sizes[] = {
 		128, 1024, 1024 * 1024, 128 * 1024 * 1024
@@ -137,7 +1591,7 @@ random_sizes_test(tlsf_mode_t mode)
 
 		while (n--) {
 			size_t cap = random() % sizes[i] + 1;
-			random_test(sizes[i], cap, mode);
+			random_test(sizes[i], cap, mode, flags);
 		}
 	}
 }
@@ -147,8 +1601,65 @@ main(void)
 {
 	srandom(time(NULL) ^ getpid());
 	basic_test();
-	random_sizes_test(TLSF_INT);
-	random_sizes_test(TLSF_EXT);
+	ext_resize_test(false);
+	ext_resize_test(true);
+	ext_alloc_at_test(0, false);
+	ext_alloc_at_test(0, true);
+	ext_alloc_at_test(TLSF_ADDRIDX, false);
+	ext_alloc_at_test(TLSF_ADDRIDX, true);
+	ext_addridx_test();
+	int_lookup_test(0);
+	int_lookup_test(TLSF_ADDRIDX);
+	int_lookup_test(TLSF_COMPACT);
+	compact_test(0, false);
+	compact_test(0, true);
+	compact_test(TLSF_ADDRIDX, false);
+	compact_test(TLSF_COMPACT, false);
+	compact_test(TLSF_COMPACT, true);
+	compact_test(TLSF_COMPACT | TLSF_ADDRIDX, false);
+	handle_ext_test(TLSF_EXT);
+	handle_ext_test(TLSF_HYBRID);
+	ext_defrag_pair(0);
+	ext_defrag_pair(TLSF_ADDRIDX);
+	goodfit_test();
+	order_test(TLSF_INT);
+	order_test(TLSF_EXT);
+	topdown_test(TLSF_INT);
+	topdown_test(TLSF_EXT);
+	victim_test();
+	defer_test();
+	density_test();
+	smallmap_test();
+	cblk_test();
+	hybrid_test();
+	inline_test(0);
+	inline_test(TLSF_COMPACT);
+	const_test(0);
+	const_test(64);
+	addrmap_clear_test();
+	reset_test(TLSF_INT, 0);
+	reset_test(TLSF_INT, TLSF_ADDRIDX);
+	reset_test(TLSF_INT, TLSF_COMPACT);
+	reset_test(TLSF_EXT, 0);
+	reset_test(TLSF_EXT, TLSF_ADDRIDX);
+	reset_test(TLSF_HYBRID, 0);
+	zero_size_test(TLSF_INT, 0);
+	zero_size_test(TLSF_INT, TLSF_COMPACT);
+	zero_size_test(TLSF_EXT, 0);
+	zero_size_test(TLSF_HYBRID, 0);
+	calloc_test(TLSF_INT, 0);
+	calloc_test(TLSF_INT, TLSF_COMPACT);
+	calloc_test(TLSF_HYBRID, 0);
+	region_test(TLSF_INT, 0);
+	region_test(TLSF_INT, TLSF_COMPACT);
+	region_test(TLSF_HYBRID, 0);
+	ring_test(TLSF_INT, 0);
+	ring_test(TLSF_INT, TLSF_COMPACT);
+	ring_test(TLSF_HYBRID, 0);
+	random_sizes_test(TLSF_INT, 0);
+	random_sizes_test(TLSF_INT, TLSF_COMPACT);
+	random_sizes_test(TLSF_EXT, 0);
+	random_sizes_test(TLSF_HYBRID, 0);
 	puts("ok");
 	return 0;
 }
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "tlsf.hpp"
+
+/* The helper macros of the private headers must not leak. */
+#if defined(MIN) || defined(MAX) || defined(ASSERT) || defined(roundup2)
+#error "tlsf.hpp leaks the helper macros"
+#endif
+
+namespace {
+
+/*
+ * The SLI of the test heaps: bounded by the one of the library, as the
+ * map is sized for it.
+ */
+constexpr unsigned
+sli(unsigned n)
+{
+	return n < tlsfpp::default_sli ? n : tlsfpp::default_sli;
+}
+
+struct obj {
+	uint64_t	val[5];
+};
+
+template <class Heap>
+void
+heap_test(void)
+{
+	const size_t len = 256 * 1024;
+	void *space = malloc(len);
+	std::vector<obj *> objs;
+	size_t unused;
+
+	assert(space != nullptr);
+	{
+		Heap h(space, len);
+
+		unused = h.unused_space();
+		for (unsigned i = 0; i < 1000; i++) {
+			obj *o = (i & 1) ? h.template allocate<obj>() :
+			    h.template allocate<obj>(i % 7 + 1);
+
+			if (o == nullptr)
+				break;
+			o->val[0] = i;
+			objs.push_back(o);
+		}
+		assert(!objs.empty());
+		for (size_t i = 0; i < objs.size(); i++) {
+			assert(objs[i]->val[0] == i);
+			if (i % 3 == 0)
+				h.deallocate(objs[i]);
+		}
+		for (size_t i = 0; i < objs.size(); i++) {
+			if (i % 3 != 0)
+				h.deallocate(objs[i]);
+		}
+		assert(h.unused_space() == unused);
+		assert(h.template allocate<obj>(SIZE_MAX / 8) == nullptr);
+
+		/* Move the ownership. */
+		Heap h2(std::move(h));
+		assert(h.get() == nullptr);
+		void *ptr = h2.alloc(100);
+		assert(ptr != nullptr);
+		h2.free(ptr);
+		assert(h2.unused_space() == unused);
+	}
+	free(space);
+}
+
+void
+config_test(void)
+{
+	const size_t len = 1024 * 1024;
+	void *space = malloc(len);
+	obj *o;
+
+	/*
+	 * Non-default SLI and MBS: the compile-time class must match the
+	 * one computed by the allocator, i.e. the blocks are reused.
+	 */
+	assert(space != nullptr);
+	{
+		tlsfpp::heap<TLSF_INT, 3, 128> h(space, len);
+
+		o = h.allocate<obj>();
+		assert(o != nullptr);
+		assert(reinterpret_cast<uintptr_t>(o) % 8 == 0);
+		h.deallocate(o);
+		assert(h.allocate<obj>() == o);
+		h.deallocate(o);
+	}
+
+	/* Too small space: the construction fails. */
+	bool failed = false;
+	try {
+		tlsfpp::heap<> h(space, 16);
+	} catch (const std::bad_alloc &) {
+		failed = true;
+	}
+	assert(failed);
+	free(space);
+}
+
+void
+ext_test(void)
+{
+	tlsfpp::heap<TLSF_EXT, sli(5), 4096, std::mutex> h(uintptr_t(0x10000),
+	    1 << 20);
+	tlsf_blk_t *blk;
+	size_t blen;
+
+	static_assert(!std::is_copy_constructible<decltype(h)>::value, "");
+	blk = h.ext_alloc(5000);
+	assert(blk != nullptr);
+	assert(tlsf_ext_getaddr(blk, &blen) == 0x10000);
+	assert(blen == 8192);
+	h.ext_free(blk);
+	assert(h.avail_space() > 0);
+}
+
+using pmr_map = std::pmr::unordered_map<unsigned, std::pmr::string>;
+
+static void
+pmr_fill(std::pmr::vector<unsigned> &vec, pmr_map &map)
+{
+	for (unsigned i = 0; i < 500; i++) {
+		vec.push_back(i);
+		map.emplace(i, std::to_string(i) + " is too long for the SSO");
+	}
+	assert(vec[499] == 499);
+	assert(map.at(42).compare(0, 3, "42 ") == 0);
+}
+
+void
+pmr_test(void)
+{
+	const size_t len = 256 * 1024;
+	void *space = malloc(len);
+	tlsfpp::heap<> h(space, len);
+	tlsfpp::memory_resource mr(h.get());
+	const size_t unused = h.unused_space();
+
+	/* The containers release their memory. */
+	{
+		std::pmr::vector<unsigned> vec(&mr);
+		pmr_map map(&mr);
+
+		pmr_fill(vec, map);
+		assert(h.unused_space() < unused);
+	}
+	assert(h.unused_space() == unused);
+
+	/*
+	 * Release the whole arena at once: the containers are dropped
+	 * without the destruction.
+	 */
+	for (unsigned i = 0; i < 3; i++) {
+		alignas(std::pmr::vector<unsigned>)
+		    unsigned char vbuf[sizeof(std::pmr::vector<unsigned>)];
+		alignas(pmr_map) unsigned char mbuf[sizeof(pmr_map)];
+		auto *vec = new (vbuf) std::pmr::vector<unsigned>(&mr);
+		auto *map = new (mbuf) pmr_map(&mr);
+
+		pmr_fill(*vec, *map);
+		mr.release();
+		assert(h.unused_space() == unused);
+	}
+
+	/* Over-aligned allocations. */
+	void *ptr = mr.allocate(100, 64);
+	assert(reinterpret_cast<uintptr_t>(ptr) % 64 == 0);
+	mr.deallocate(ptr, 100, 64);
+	assert(h.unused_space() == unused);
+
+	/* The zero-size allocations get unique pointers. */
+	void *ptr0 = mr.allocate(0), *ptr1 = mr.allocate(0, 64);
+	assert(ptr0 != nullptr && ptr1 != nullptr && ptr0 != ptr1);
+	mr.deallocate(ptr0, 0);
+	mr.deallocate(ptr1, 0, 64);
+	assert(h.alloc(0) == nullptr);
+	assert(h.unused_space() == unused);
+
+	tlsfpp::memory_resource mr2(h.get());
+	assert(mr.is_equal(mr2));
+	assert(!mr.is_equal(*std::pmr::new_delete_resource()));
+
+	bool failed = false;
+	try {
+		(void)mr.allocate(len);
+	} catch (const std::bad_alloc &) {
+		failed = true;
+	}
+	assert(failed);
+	free(space);
+}
+
+struct test_tag {};
+
+void
+allocator_test(void)
+{
+	const size_t len = 256 * 1024;
+	void *space = malloc(len);
+	tlsfpp::heap<TLSF_HYBRID> h(space, len);
+	const size_t unused = h.unused_space();
+
+	using alloc_t = tlsfpp::allocator<int, test_tag>;
+	struct alignas(32) wide { char c[40]; };
+
+	static_assert(sizeof(alloc_t) == 1, "");
+	tlsfpp::arena<test_tag>::bind(h.get());
+	{
+		std::vector<int, alloc_t> vec;
+		std::map<int, int, std::less<int>,
+		    tlsfpp::allocator<std::pair<const int, int>, test_tag>> map;
+		std::vector<wide, tlsfpp::allocator<wide, test_tag>> wvec(10);
+
+		for (int i = 0; i < 1000; i++) {
+			vec.push_back(i);
+			map[i] = -i;
+		}
+		assert(vec[500] == 500 && map[500] == -500);
+		assert(reinterpret_cast<uintptr_t>(wvec.data()) % 32 == 0);
+		assert((alloc_t() == tlsfpp::allocator<long, test_tag>()));
+	}
+	assert(h.unused_space() == unused);
+
+	/* Reset the arena at once. */
+	alloc_t a;
+	int *p = a.allocate(100);
+	assert(p != nullptr);
+	tlsfpp::arena<test_tag>::release();
+	assert(h.unused_space() == unused);
+	tlsfpp::arena<test_tag>::bind(nullptr);
+	free(space);
+}
+
+} // namespace
+
+int
+main(void)
+{
+	heap_test<tlsfpp::heap<>>();
+	heap_test<tlsfpp::heap<TLSF_INT, sli(6), 64, std::mutex>>();
+	heap_test<tlsfpp::heap<TLSF_HYBRID, sli(4), 32>>();
+	config_test();
+	ext_test();
+	pmr_test();
+	allocator_test();
+	puts("ok");
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * The tests of the malloc(3) interposition library: it is linked into
+ * the program, therefore it replaces the allocator of the C library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <malloc.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <assert.h>
+
+#define	NTHREADS	8
+#define	NPTRS		1024
+
+static void
+basic_test(void)
+{
+	volatile size_t huge = SIZE_MAX / 2;
+	char *p, *s;
+	void *ptr;
+
+	/* The TLSF rounding: the minimum block size is 32. */
+	p = malloc(1);
+	assert(p != NULL);
+	assert(malloc_usable_size(p) == 32);
+	free(p);
+
+	/* The C library allocations are served too. */
+	s = strdup("tlsf");
+	assert(s != NULL && malloc_usable_size(s) == 32);
+	free(s);
+
+	p = calloc(1000, 10);
+	assert(p != NULL);
+	for (unsigned i = 0; i < 10000; i++) {
+		assert(p[i] == 0);
+	}
+	memset(p, 0xa5, 10000);
+	free(p);
+	p = calloc(1000, 10);
+	assert(p != NULL && p[0] == 0 && p[9999] == 0);
+	free(p);
+	assert(calloc(huge, 4) == NULL && errno == ENOMEM);
+
+	/* Reallocation preserves the contents. */
+	p = malloc(100);
+	for (unsigned i = 0; i < 100; i++) {
+		p[i] = (char)i;
+	}
+	p = realloc(p, 5000);
+	assert(p != NULL && malloc_usable_size(p) >= 5000);
+	for (unsigned i = 0; i < 100; i++) {
+		assert(p[i] == (char)i);
+	}
+	p = realloc(p, 10);
+	assert(p != NULL && p[9] == 9);
+	assert(realloc(p, 0) == NULL);
+
+	/* Large allocations are mapped directly. */
+	p = malloc(64 * 1024 * 1024);
+	assert(p != NULL);
+	p[0] = 1;
+	p[64 * 1024 * 1024 - 1] = 1;
+	assert(malloc_usable_size(p) >= 64 * 1024 * 1024);
+	p = realloc(p, 100);
+	assert(p != NULL && p[0] == 1);
+	free(p);
+	assert(malloc(huge * 2) == NULL && errno == ENOMEM);
+
+	ptr = malloc(0);
+	assert(ptr != NULL);
+	free(ptr);
+	free(NULL);
+	assert(malloc_usable_size(NULL) == 0);
+}
+
+static void
+align_test(void)
+{
+	const size_t aligns[] = { 8, 16, 32, 64, 4096, 65536, 1 << 21 };
+	const size_t sizes[] = { 1, 100, 5000, 16 * 1024 * 1024 };
+	void *ptr;
+
+	for (unsigned i = 0; i < sizeof(aligns) / sizeof(aligns[0]); i++) {
+		for (unsigned j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			const size_t align = aligns[i], size = sizes[j];
+
+			assert(posix_memalign(&ptr, align, size) == 0);
+			assert(((uintptr_t)ptr & (align - 1)) == 0);
+			assert(malloc_usable_size(ptr) >= size);
+			memset(ptr, 0x5a, size);
+			free(ptr);
+
+			ptr = aligned_alloc(align, size);
+			assert(ptr != NULL);
+			assert(((uintptr_t)ptr & (align - 1)) == 0);
+			ptr = realloc(ptr, size * 2);
+			assert(ptr != NULL);
+			free(ptr);
+		}
+	}
+	assert(posix_memalign(&ptr, 24, 100) == EINVAL);
+	assert(posix_memalign(&ptr, 4, 100) == EINVAL);
+	assert(aligned_alloc(3, 100) == NULL && errno == EINVAL);
+
+	ptr = memalign(256, 300);
+	assert(ptr != NULL && ((uintptr_t)ptr & 255) == 0);
+	free(ptr);
+	ptr = valloc(1);
+	assert(ptr != NULL && ((uintptr_t)ptr & 4095) == 0);
+	free(ptr);
+	ptr = pvalloc(1);
+	assert(ptr != NULL && malloc_usable_size(ptr) >= 4096);
+	free(ptr);
+}
+
+/*
+ * Each thread allocates and frees the random sizes; half of the blocks
+ * are passed to the next thread, which frees them (the remote frees).
+ */
+static void *volatile	handoff[NTHREADS][NPTRS];
+static pthread_barrier_t barrier;
+
+static void *
+thread_run(void *arg)
+{
+	const unsigned id = (unsigned)(uintptr_t)arg;
+	const unsigned next = (id + 1) % NTHREADS;
+	unsigned seed = id;
+	char *ptrs[NPTRS];
+
+	for (unsigned round = 0; round < 50; round++) {
+		for (unsigned i = 0; i < NPTRS; i++) {
+			const size_t size = 1 + rand_r(&seed) % 4096;
+
+			ptrs[i] = malloc(size);
+			assert(ptrs[i] != NULL);
+			memset(ptrs[i], (int)id, size);
+		}
+		for (unsigned i = 0; i < NPTRS; i++) {
+			assert(ptrs[i][0] == (char)id);
+			if (i & 1) {
+				free(ptrs[i]);
+			} else {
+				handoff[next][i] = ptrs[i];
+			}
+		}
+		pthread_barrier_wait(&barrier);
+		for (unsigned i = 0; i < NPTRS; i += 2) {
+			char *p = handoff[id][i];
+
+			assert(p[0] == (char)((id + NTHREADS - 1) % NTHREADS));
+			free(p);
+		}
+		pthread_barrier_wait(&barrier);
+	}
+	return NULL;
+}
+
+static void
+threads_test(void)
+{
+	pthread_t thr[NTHREADS];
+
+	pthread_barrier_init(&barrier, NULL, NTHREADS);
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		int ret = pthread_create(&thr[i], NULL,
+		    thread_run, (void *)(uintptr_t)i);
+		assert(ret == 0);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		pthread_join(thr[i], NULL);
+	}
+	pthread_barrier_destroy(&barrier);
+}
+
+/*
+ * While the other threads allocate, fork: the child must be able to use
+ * the allocator, i.e. no lock is left held.
+ */
+static volatile bool	fork_done;
+
+static void *
+fork_thread(void *arg)
+{
+	(void)arg;
+	while (!fork_done) {
+		free(malloc(100));
+	}
+	return NULL;
+}
+
+static void
+fork_test(void)
+{
+	pthread_t thr[4];
+
+	for (unsigned i = 0; i < 4; i++) {
+		int ret = pthread_create(&thr[i], NULL, fork_thread, NULL);
+		assert(ret == 0);
+	}
+	for (unsigned i = 0; i < 20; i++) {
+		char *p = malloc(1000);
+		pid_t pid;
+		int status;
+
+		pid = fork();
+		assert(pid != -1);
+		if (pid == 0) {
+			for (unsigned j = 0; j < 1000; j++) {
+				free(malloc(j * 10));
+			}
+			free(p);
+			_exit(0);
+		}
+		assert(waitpid(pid, &status, 0) == pid);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+		free(p);
+	}
+	fork_done = true;
+	for (unsigned i = 0; i < 4; i++) {
+		pthread_join(thr[i], NULL);
+	}
+}
+
+int
+main(void)
+{
+	basic_test();
+	align_test();
+	threads_test();
+	fork_test();
+	puts("ok");
+	return 0;
+}
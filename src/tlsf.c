@@ -40,525 +40,351 @@
  *	The free operation is performed by first attempting to merge the
  *	returned block with the adjacent physical blocks; then the block
  *	inserted into the free list.
+ *
+ *	This file provides the interface.  The allocator itself is in
+ *	tlsf_core.c, which is compiled for each block header layout, so
+ *	the mode is resolved once per call (see CORE_CALL).
  */
 
-#include <sys/queue.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <stddef.h>
-#include <stdbool.h>
-#include <string.h>
-#include <inttypes.h>
-#include <limits.h>
-#include <strings.h>
 
-#include "tlsf.h"
-#include "utils.h"
+#include "tlsf_impl.h"
+#include "tlsf_inline.h"
 
 /*
- * The maximum number of L1 items: just use 2^64 on 64-bit architectures.
- * Otherwise, log2(4 GB) = 32.
+ * Allocation profile: the first-level classes with at least 1/8 of the
+ * allocations get the maximum density; the unused classes get 8 lists.
  */
-#define	TLSF_FLI_MAX		(CHAR_BIT * sizeof(unsigned long))
+#define	TLSF_PROFILE_HOT	8
+#define	TLSF_DENSITY_COLD	3
 
 /*
- * The number of subdivisions (second-level-index), expressed as an
- * exponent of 2 for bitwise shifting.  2^5 = 32 subdivisions.
+ * The granularity of the address index for TLSF-INT, expressed as an
+ * exponent of 2: 2^12 = 4 KB pages.
  */
-#define	TLSF_SLI_SHIFT		5
-#define	TLSF_SLI_MAX		(1UL << TLSF_SLI_SHIFT)
+#define	TLSF_IDX_INT_SHIFT	12
 
 /*
- * Default minimum block size.
+ * CORE_CALL: call the function of the core instance for the block header
+ * layout of the object: TLSF-INT, TLSF-INT with the compact headers or
+ * TLSF-EXT (also used by TLSF-HYBRID).
  */
-#define	TLSF_MBS_DEFAULT	32
+#define	CORE_CALL(tlsf, fn, args)					\
+    ((tlsf)->blk_hdr_len == TLSF_BLKHDR_LEN ? core_int_##fn args :	\
+    (tlsf)->blk_hdr_len ? core_cint_##fn args : core_ext_##fn args)
 
 /*
- * Each memory block is tracked using a block header.  There are two
- * cases: TLSF-INT and TLSF-EXT i.e. internalised or externalised block
- * header use.
- *
- * - TLSF-INT case has block header (tlsf_blk_t) prepended at the
- *   beginning of the allocated space.  Therefore, allocation function
- *   always increments the requested size by the TLSF_BLKHDR_LEN.
- *
- * - TLSF-INT: Used (allocated) memory blocks use the whole tlsf_blk_t,
- *   while free blocks have do not use segregation list entries,
- *   therefore their effective size is reduced TLSF_BLKHDR_LEN.
- *
- * - TLSF-EXT case has a separate header (tlsf_extblk_t) allocated
- *   externally for the both cases i.e. allocated and free.  The header
- *   additionally stores the address (tlsf_blk_t::addr).
- *
- * - All block headers are linked in the order of the physical address
- *   they represent.  TLSF-INT uses 'prevblk' member and is linked only
- *   backwards (next header can be worked out based on the block length).
- *   TLSF-EXT uses doubly linked list (tlsf_extblk_t::entry).
- *
- * - Free blocks are additionally linked within their size class.
- *
- * - The length field stores the block length excluding the header.
+ * INT_CALL: same as CORE_CALL, but for the TLSF-INT only interface.
  */
+#define	INT_CALL(tlsf, fn, args)					\
+    ((tlsf)->blk_hdr_len == TLSF_BLKHDR_LEN ?				\
+    core_int_##fn args : core_cint_##fn args)
 
-#define	TLSF_BLK_FREE		(~(SIZE_MAX >> 1))
-
-struct tlsf_blk {
-	/*
-	 * Length and:
-	 * - TLSF-EXT: real address
-	 * - TLSF-INT: previous block
-	 */
-	size_t			len;
-	union {
-		uintptr_t	addr;
-		struct tlsf_blk *prevblk;
-	};
-
-	/* Segregation list entries. */
-	struct tlsf_blk *	next;
-	struct tlsf_blk *	prev;
-};
-
-#define	TLSF_BLKHDR_LEN		(offsetof(tlsf_blk_t, next))
-
-typedef struct tlsf_extblk {
-	/*
-	 * The main header and the physical block chain.
-	 */
-	tlsf_blk_t		hdr;
-	TAILQ_ENTRY(tlsf_extblk) entry;
-} tlsf_extblk_t;
-
-struct tlsf {
-	/* Base pointer, size of the whole space. */
-	uintptr_t		baseptr;
-	size_t			size;
-	size_t			free;
-	unsigned		mbs;
-
-	/*
-	 * Prepended the block header length (TLSF-INT only).
-	 * If zero, TLSF-EXT is being used.
-	 */
-	unsigned		blk_hdr_len;
-	TAILQ_HEAD(tlsf_extblk_qh, tlsf_extblk) blklist;
+tlsf_blk_t *
+tlsf_ext_alloc(tlsf_t *tlsf, size_t size)
+{
+	return tlsf_ext_alloc2(tlsf, size, 0);
+}
 
-	unsigned long		l1_free;
-	unsigned long		l2_free[TLSF_FLI_MAX];
-	tlsf_blk_t *		map[TLSF_FLI_MAX][TLSF_SLI_MAX];
-};
+tlsf_blk_t *
+tlsf_ext_alloc2(tlsf_t *tlsf, size_t size, unsigned flags)
+{
+	return CORE_CALL(tlsf, alloc, (tlsf, size, flags));
+}
 
 /*
- * get_mapping: given the size return FLI and SLI.
+ * tlsf_ext_alloc_at: allocate the space at the given address and of the
+ * given length.  The range is rounded to the MBS boundaries and must be
+ * entirely free; the remainders on both sides are kept free.
+ *
+ * => Only supported with TLSF-EXT.
+ * => Finding the free block containing the range takes linear time,
+ *    unless the address index is enabled.
  */
-static inline void
-get_mapping(size_t size, unsigned *fli, unsigned *sli)
+tlsf_blk_t *
+tlsf_ext_alloc_at(tlsf_t *tlsf, uintptr_t addr, size_t size)
 {
-	/*
-	 * => First-level-index (FLI) = log2(size)
-	 * => Second-level-index (SLI) = (size - 2^f) * (2^SLI / 2^f)
-	 *
-	 * The SLI can be calculated using bitwise operations:
-	 * - We clear 2^FLI bit to get the subsize for SLI.
-	 * - FLI itself is the maximum subsize within the FL class.
-	 *
-	 * Therefore:
-	 *
-	 *	subsize = (size ^ (1U << FLI))
-	 *	SLI = (subsize * TLSF_SLI_MAX) / max_subsize
-	 *	    = (subsize * TLSF_SLI_MAX) / 2^FLI
-	 *	    = (subsize << TLSF_SLI_SHIFT) >> FLI
-	 *	    = subsize >> (FLI - TLSF_SLI)
-	 */
-	*fli = ilog2(size);
-	*sli = (size ^ (1UL << *fli)) >> (*fli - TLSF_SLI_SHIFT);
-	ASSERT(*fli < TLSF_FLI_MAX);
-	ASSERT(*sli < TLSF_SLI_MAX);
+	if (tlsf->blk_hdr_len || size == 0) {
+		return NULL;
+	}
+	return core_ext_alloc_at(tlsf, addr, size);
 }
 
-static inline size_t
-block_length(const tlsf_blk_t *blk)
+void *
+tlsf_alloc(tlsf_t *tlsf, size_t size)
 {
-	return (blk->len & ~TLSF_BLK_FREE);
+	return tlsf_alloc2(tlsf, size, 0);
 }
 
-static inline bool
-block_free_p(const tlsf_blk_t *blk)
+void *
+tlsf_alloc2(tlsf_t *tlsf, size_t size, unsigned flags)
 {
-	return (blk->len & TLSF_BLK_FREE) != 0;
+	return CORE_CALL(tlsf, ptr_alloc, (tlsf, size, flags));
 }
 
 /*
- * get_{prev,next}_physblk: given the block header, return the previous
- * or next physical block.
+ * tlsf_calloc: allocate the zero-filled memory for an array of 'nmemb'
+ * elements of the given size.  Returns NULL on failure.
+ *
+ * => The blocks known to be zero-filled (see TLSF_ZEROED) are not zeroed
+ *    again, except the list entries which the free TLSF-INT block held.
+ * => The large ranges are zeroed using the non-temporal stores.
  */
-
-static inline tlsf_blk_t *
-get_prev_physblk(const tlsf_t *tlsf, tlsf_blk_t *blk)
+void *
+tlsf_calloc(tlsf_t *tlsf, size_t nmemb, size_t size)
 {
-	if (tlsf->blk_hdr_len) {
-		ASSERT(tlsf->blk_hdr_len == TLSF_BLKHDR_LEN);
-		ASSERT(TAILQ_EMPTY(&tlsf->blklist));
-		return blk->prevblk;
-	} else {
-		tlsf_extblk_t *extblk = (void *)blk;
-		return (void *)TAILQ_PREV(extblk, tlsf_extblk_qh, entry);
+	if (size && nmemb > SIZE_MAX / size) {
+		return NULL;
 	}
+	return CORE_CALL(tlsf, ptr_alloc, (tlsf, nmemb * size,
+	    TLSF_ALLOC_ZERO));
 }
 
-static inline tlsf_blk_t *
-get_next_physblk(const tlsf_t *tlsf, tlsf_blk_t *blk)
+void
+tlsf_ext_free(tlsf_t *tlsf, tlsf_blk_t *blk)
 {
-	if (tlsf->blk_hdr_len) {
-		uintptr_t space_end = (uintptr_t)tlsf->baseptr + tlsf->size;
-		uintptr_t nblkptr;
-
-		ASSERT(tlsf->blk_hdr_len == TLSF_BLKHDR_LEN);
-		ASSERT(TAILQ_EMPTY(&tlsf->blklist));
-		nblkptr = (uintptr_t)blk + TLSF_BLKHDR_LEN + block_length(blk);
-		ASSERT(nblkptr <= space_end);
-		return nblkptr < space_end ? (tlsf_blk_t *)nblkptr : NULL;
-	} else {
-		tlsf_extblk_t *extblk = (void *)blk;
-		return (void *)TAILQ_NEXT(extblk, entry);
-	}
+	CORE_CALL(tlsf, free, (tlsf, blk));
+}
+
+void
+tlsf_free(tlsf_t *tlsf, void *ptr)
+{
+	CORE_CALL(tlsf, ptr_free, (tlsf, ptr));
 }
 
-#ifndef NDEBUG
 /*
- * validate_blkhdr: diagnostic function to validate the consistency of
- * the given block header and pointers to its physical neighbours.
+ * tlsf_inline_split: the out-of-line part of tlsf_alloc_inline(), i.e.
+ * split the block taken off the list, if it is larger than needed.
  */
-static bool
-validate_blkhdr(const tlsf_t *tlsf, tlsf_blk_t *blk)
+void *
+tlsf_inline_split(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
 {
-	const uintptr_t addr = tlsf->blk_hdr_len ? (uintptr_t)blk : blk->addr;
-	const uintptr_t space_start = tlsf->baseptr;
-	const uintptr_t space_end = tlsf->baseptr + tlsf->size;
-	tlsf_blk_t *nextblk = get_next_physblk(tlsf, blk);
-	tlsf_blk_t *prevblk = get_prev_physblk(tlsf, blk);
-	const size_t blen = block_length(blk);
-
-	/* The block should be at least MBS, but not more than total. */
-	ASSERT(blen >= tlsf->mbs);
-	ASSERT(blen <= tlsf->size);
-
-	/* The block should be within the boundaries. */
-	ASSERT(addr >= space_start);
-	ASSERT(addr < space_end);
-
-	/*
-	 * The "next" (based on calculation) of the previous block should
-	 * point to us and the next block should have a link to us.  Unless
-	 * this is the first or the last physical block respectively.
-	 */
-	ASSERT(addr == space_start || get_next_physblk(tlsf, prevblk) == blk);
-	ASSERT(!nextblk || get_prev_physblk(tlsf, nextblk) == blk);
-	return true;
+	return INT_CALL(tlsf, split, (tlsf, blk, size));
 }
-#endif
 
-static inline tlsf_blk_t *
-block_hdr_alloc(tlsf_t *tlsf, tlsf_blk_t *parent, size_t len)
+/*
+ * tlsf_lookup: given a pointer anywhere within the allocated memory
+ * (i.e. an interior pointer), return the pointer to the start of the
+ * allocation or NULL, if the address is not allocated.
+ *
+ * => Takes O(log n) time if the address index is enabled (TLSF_ADDRIDX);
+ *    otherwise, linear time.
+ */
+void *
+tlsf_lookup(tlsf_t *tlsf, const void *ptr)
 {
-	tlsf_blk_t *blk;
-
-	if (tlsf->blk_hdr_len) {
-		const size_t plen = block_length(parent);
-		tlsf_blk_t *nblk;
-
-		/*
-		 * Acquire area after the parent for the block header
-		 * and set the length before calculating the pointers.
-		 */
-		blk = (void *)((uint8_t *)parent + TLSF_BLKHDR_LEN + plen);
-		blk->len = len;
-
-		/*
-		 * Set the previous *physical* block pointers: both for our
-		 * block and the block after the newly created block.
-		 */
-		blk->prevblk = parent;
-		nblk = get_next_physblk(tlsf, blk);
-		if (nblk) {
-			nblk->prevblk = blk;
-		}
-	} else {
-		tlsf_extblk_t *extblk, *pextblk = (void *)parent;
-
-		if ((extblk = malloc(sizeof(tlsf_extblk_t))) == NULL) {
-			return NULL;
-		}
-		blk = &extblk->hdr;
-		blk->len = len;
-		blk->addr = parent->addr + parent->len;
-		TAILQ_INSERT_AFTER(&tlsf->blklist, pextblk, extblk, entry);
-	}
-	return blk;
+	return CORE_CALL(tlsf, ptr_lookup, (tlsf, ptr));
 }
 
-static inline void
-block_hdr_free(tlsf_t *tlsf, tlsf_blk_t *blk)
+/*
+ * tlsf_handle_alloc: allocate a relocatable block of memory and return
+ * a handle referencing it, or zero on failure.  The memory is accessed
+ * using tlsf_handle_ptr() and it may be moved by tlsf_compact().
+ *
+ * => TLSF-INT only; returns zero in the other modes.  The handle is
+ *    stored in front of the data.
+ * => The handle table is grown by doubling: the growth itself is not
+ *    bounded in time.
+ */
+tlsf_handle_t
+tlsf_handle_alloc(tlsf_t *tlsf, size_t size)
 {
-	ASSERT(!block_free_p(blk));
-
-	if (tlsf->blk_hdr_len) {
-		tlsf_blk_t *nextblk;
-
-		if ((nextblk = get_next_physblk(tlsf, blk)) != NULL) {
-			nextblk->prevblk = blk->prevblk;
-			ASSERT(validate_blkhdr(tlsf, nextblk));
-		}
-		ASSERT(memset(blk, 0, sizeof(tlsf_blk_t)));
-	} else {
-		tlsf_extblk_t *extblk = (void *)blk;
-		TAILQ_REMOVE(&tlsf->blklist, extblk, entry);
-		ASSERT(memset(extblk, 0, sizeof(tlsf_extblk_t)));
-		free(extblk);
+	if (!tlsf->blk_hdr_len) {
+		return 0;
 	}
+	return INT_CALL(tlsf, handle_alloc, (tlsf, size));
 }
 
-static void
-insert_block(tlsf_t *tlsf, tlsf_blk_t *blk)
+/*
+ * tlsf_handle_ptr: return the pointer to the memory of the given handle.
+ * The pointer is valid until the next tlsf_compact() call.
+ */
+void *
+tlsf_handle_ptr(tlsf_t *tlsf, tlsf_handle_t h)
 {
-	unsigned fli, sli;
-	tlsf_blk_t *head;
-
-	ASSERT(validate_blkhdr(tlsf, blk));
-	ASSERT(!block_free_p(blk));
-
-	/*
-	 * Get the FLI/SLI and insert the block.
-	 */
-	get_mapping(blk->len, &fli, &sli);
-	head = tlsf->map[fli][sli];
-	if (head) {
-		head->prev = blk;
-	}
-	blk->prev = NULL;
-	blk->next = head;
-	tlsf->map[fli][sli] = blk;
-
-	/* Mark the block as free. */
-	tlsf->free += blk->len;
-	blk->len |= TLSF_BLK_FREE;
-
-	/* Finally, indicate that the lists have free blocks. */
-	tlsf->l1_free |= (1UL << fli);
-	tlsf->l2_free[fli] |= (1UL << sli);
+	ASSERT(h > 0 && h <= tlsf->hsize);
+	ASSERT(!HTAB_FREE_P(tlsf->htab[h - 1]));
+	return tlsf->htab[h - 1];
 }
 
-static tlsf_blk_t *
-remove_block(tlsf_t *tlsf, tlsf_blk_t *target, unsigned fli, unsigned sli)
+void
+tlsf_handle_free(tlsf_t *tlsf, tlsf_handle_t h)
 {
-	tlsf_blk_t *blk = target;
-
-	/*
-	 * Take a block from the map, unless explicitly specified.
-	 */
-	if (!target) {
-		blk = tlsf->map[fli][sli];
-		ASSERT(blk);
-	}
-
-	/*
-	 * Unlink the block.
-	 */
-	if (blk->next) {
-		blk->next->prev = blk->prev;
-	}
-	if (blk->prev) {
-		blk->prev->next = blk->next;
-	}
-	if (tlsf->map[fli][sli] == blk) {
-		tlsf->map[fli][sli] = blk->next;
-	}
-
-	/* Clear the free flag. */
-	ASSERT(block_free_p(blk));
-	blk->len &= ~TLSF_BLK_FREE;
-	tlsf->free -= blk->len;
+	INT_CALL(tlsf, handle_free, (tlsf, h));
+}
 
-	/*
-	 * Last block in SL?  Clear the "free" flag.  If there are SL
-	 * lists with free blocks in the FL class - clear the FL too.
-	 */
-	if (!blk->next) {
-		tlsf->l2_free[fli] &= ~(1UL << sli);
-		if (tlsf->l2_free[fli] == 0) {
-			tlsf->l1_free &= ~(1UL << fli);
-		}
+/*
+ * tlsf_compact: perform a step of the incremental compaction.  The
+ * relocatable blocks are moved towards the lower addresses, so that the
+ * free blocks would coalesce.  The step moves at most 'budget' bytes
+ * and visits at most TLSF_COMPACT_SCAN blocks.
+ *
+ * => Returns 1 if the pass over the space is not yet complete, i.e. the
+ *    caller should perform more steps, and 0 once it is complete.
+ * => The pointers obtained using tlsf_handle_ptr() become invalid.
+ */
+int
+tlsf_compact(tlsf_t *tlsf, size_t budget)
+{
+	if (!tlsf->blk_hdr_len) {
+		return 0;
 	}
-	ASSERT(validate_blkhdr(tlsf, blk));
-	return blk;
+	return INT_CALL(tlsf, compact, (tlsf, budget));
 }
 
-static inline tlsf_blk_t *
-split_block(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+uintptr_t
+tlsf_ext_getaddr(const tlsf_blk_t *blk, size_t *length)
 {
-	tlsf_blk_t *remblk;
-	size_t remsize;
-
-	/* Calculate the remaining size and set the new size. */
-	remsize = block_length(blk) - tlsf->blk_hdr_len - size;
-	ASSERT((remsize & TLSF_BLK_FREE) == 0);
-	ASSERT((size & TLSF_BLK_FREE) == 0);
-	blk->len = size;
-
-	/*
-	 * Allocate a new block, inheriting the remaining memory
-	 * from the parent block.
-	 */
-	remblk = block_hdr_alloc(tlsf, blk, remsize);
-	if (remblk) {
-		ASSERT(!block_free_p(blk));
-		ASSERT(!block_free_p(remblk));
-	} else {
-		blk->len = size + remsize;
+	if (length) {
+		*length = blk->len & ~TLSF_BLK_FLAGS;
 	}
-	return remblk;
+	return blk->addr;
 }
 
 /*
- * merge_blocks: merge two physically adjacent blocks - the target block
- * and a block next to it.
+ * tlsf_ext_lookup: return the allocated block containing the given
+ * address or NULL, if the address is free or out of the space.
+ *
+ * => Takes O(log n) time if the address index is enabled (TLSF_ADDRIDX);
+ *    otherwise, linear time.
  */
-static inline tlsf_blk_t *
-merge_blocks(tlsf_t *tlsf, tlsf_blk_t *blk, tlsf_blk_t *blk2)
+tlsf_blk_t *
+tlsf_ext_lookup(tlsf_t *tlsf, uintptr_t addr)
 {
-	const size_t addlen = block_length(blk2);
-	unsigned fli, sli;
-
-	ASSERT(validate_blkhdr(tlsf, blk));
-	ASSERT(validate_blkhdr(tlsf, blk2));
-
-	/* Ensure that both blocks are removed from the list. */
-	if (block_free_p(blk)) {
-		get_mapping(block_length(blk), &fli, &sli);
-		(void)remove_block(tlsf, blk, fli, sli);
-	}
-	if (block_free_p(blk2)) {
-		get_mapping(addlen, &fli, &sli);
-		(void)remove_block(tlsf, blk2, fli, sli);
+	if (tlsf->blk_hdr_len) {
+		return NULL;
 	}
-
-	/*
-	 * Add the extra space to the first block.  Finally,
-	 * remove and destroy the second block.
-	 */
-	blk->len += tlsf->blk_hdr_len + addlen;
-	block_hdr_free(tlsf, blk2);
-	return blk;
+	return core_ext_lookup(tlsf, addr);
 }
 
-tlsf_blk_t *
-tlsf_ext_alloc(tlsf_t *tlsf, size_t size)
+/*
+ * tlsf_ext_free_addr: release the previously allocated space, given the
+ * address it starts at.  Returns 0 on success and -1 if there is no
+ * allocated block starting at the address.
+ */
+int
+tlsf_ext_free_addr(tlsf_t *tlsf, uintptr_t addr)
 {
-	const unsigned mbs = tlsf->mbs;
-	unsigned fli, sli;
 	tlsf_blk_t *blk;
-	size_t target;
-
-	/*
-	 * Round up the size to MBS and then the next size class.
-	 * Get the FL/SL indexes of the size.
-	 */
-	size = roundup2(size, mbs);
-	target = size + (1UL << (ilog2(size) - TLSF_SLI_SHIFT)) - 1;
-	get_mapping(target, &fli, &sli);
 
-	/*
-	 * Find a free block.  Fast path: look at the current FLI.
-	 * Otherwise, look at next FLI starting with zero SLI.
-	 */
-	sli = ffsl(tlsf->l2_free[fli] & (~0UL << sli));
-	if (sli == 0) {
-		fli = ffsl(tlsf->l1_free & (~0UL << ++fli));
-		if (__predict_false(fli == 0)) {
-			return NULL;
-		}
-		sli = ffsl(tlsf->l2_free[--fli]);
-		ASSERT(sli != 0);
+	if ((blk = tlsf_ext_lookup(tlsf, addr)) == NULL || blk->addr != addr) {
+		return -1;
 	}
-	sli--;
-
-	/*
-	 * Remove a block from the list.
-	 */
-	blk = remove_block(tlsf, NULL, fli, sli);
-	ASSERT(blk != NULL);
-	ASSERT(block_length(blk) >= size);
-
-	/*
-	 * If the block is larger than the threshold, then split it.
-	 */
-	if ((blk->len - size) >= (mbs + tlsf->blk_hdr_len)) {
-		tlsf_blk_t *remblk;
+	tlsf_ext_free(tlsf, blk);
+	return 0;
+}
 
-		remblk = split_block(tlsf, blk, size);
-		if (remblk) {
-			insert_block(tlsf, remblk);
-		}
-	}
-	return blk;
+/*
+ * tlsf_ext_trim: shrink the allocated block to the given size, giving
+ * the tail of the space back to the free lists.  The block keeps its
+ * start address.  Returns 0 on success and -1 on failure.
+ */
+int
+tlsf_ext_trim(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+{
+	return CORE_CALL(tlsf, trim, (tlsf, blk, size));
 }
 
-void *
-tlsf_alloc(tlsf_t *tlsf, size_t size)
+/*
+ * tlsf_ext_extend: grow the allocated block to the given size in place,
+ * by taking the space from the next physical block, if it is free and
+ * large enough.  Returns 0 on success and -1 on failure.
+ */
+int
+tlsf_ext_extend(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
 {
-	tlsf_blk_t *blk;
-	void *ptr;
+	return CORE_CALL(tlsf, extend, (tlsf, blk, size));
+}
 
-	ASSERT(tlsf->blk_hdr_len == TLSF_BLKHDR_LEN);
-	blk = tlsf_ext_alloc(tlsf, size);
-	if (blk == NULL) {
-		return NULL;
+/*
+ * tlsf_ext_defrag: perform a step of the incremental defragmentation of
+ * the TLSF-EXT space.  The step visits at most TLSF_COMPACT_SCAN blocks,
+ * picks the allocated block whose relocation would merge the most free
+ * space, i.e. the block with the largest free neighbours, and relocates
+ * it using the given move function, if its length is within the budget.
+ *
+ * => The move function is called with the old address, the new address
+ *    and the length; it must copy the data and return 0 or, on failure,
+ *    return -1, in which case the block stays at its old address.
+ * => The block references remain valid, but their address changes.
+ * => Returns 1 if the pass over the space is not yet complete, 0 once it
+ *    is complete and -1 if the move function failed.
+ */
+int
+tlsf_ext_defrag(tlsf_t *tlsf, size_t budget, tlsf_move_func_t move,
+    void *arg)
+{
+	if (tlsf->blk_hdr_len) {
+		return 0;
 	}
-	ptr = (uint8_t *)blk + TLSF_BLKHDR_LEN;
-	ASSERT(((uintptr_t)ptr & (sizeof(unsigned long) - 1)) == 0);
-	return ptr;
+	return core_ext_defrag(tlsf, budget, move, arg);
 }
 
-void
-tlsf_ext_free(tlsf_t *tlsf, tlsf_blk_t *blk)
+/*
+ * tlsf_setdensity: set the number of the second-level subdivisions of the
+ * first-level class which contains the given size.  The count must be a
+ * power of 2, up to 64.  The free blocks get re-inserted, therefore it
+ * takes linear time.  Returns 0 on success and -1 on failure, e.g. if the
+ * total number of lists would exceed the maximum map size.
+ */
+int
+tlsf_setdensity(tlsf_t *tlsf, size_t size, unsigned count)
 {
-	tlsf_blk_t *prevblk, *nextblk;
-
-	ASSERT(!block_free_p(blk)); /* use-after-free guard */
-
-	/* Get the adjacent blocks. */
-	prevblk = get_prev_physblk(tlsf, blk);
-	nextblk = get_next_physblk(tlsf, blk);
+	uint8_t density[TLSF_FLI_MAX];
 
-	/*
-	 * Try to merge adjacent blocks.
-	 */
-	if (prevblk && block_free_p(prevblk)) {
-		blk = merge_blocks(tlsf, prevblk, blk);
+	if (size == 0 || !class_used_p(tlsf->mbs, tlsf->size, ilog2(size)) ||
+	    count == 0 ||
+	    (count & (count - 1)) != 0 || count > (1U << TLSF_DENSITY_MAX)) {
+		return -1;
 	}
-	if (nextblk && block_free_p(nextblk)) {
-		blk = merge_blocks(tlsf, blk, nextblk);
+	for (unsigned fli = 0; fli < TLSF_FLI_MAX; fli++) {
+		density[fli] = 0;
+		if (class_used_p(tlsf->mbs, tlsf->size, fli))
+			density[fli] = fli - tlsf_class_shift(tlsf, fli);
 	}
-	insert_block(tlsf, blk);
+	density[ilog2(size)] = ilog2(count);
+	return CORE_CALL(tlsf, set_density, (tlsf, density));
 }
 
-void
-tlsf_free(tlsf_t *tlsf, void *ptr)
+/*
+ * apply_profile: set the density of the first-level classes based on the
+ * collected allocation profile: the maximum for the classes with most of
+ * the allocations, the default for the other allocated classes and the
+ * minimum for the rest.
+ */
+static void
+apply_profile(tlsf_t *tlsf)
 {
-	tlsf_blk_t *blk;
+	const size_t *profile = tlsf->profile;
+	uint8_t density[TLSF_FLI_MAX], hot = TLSF_DENSITY_MAX;
+	size_t total = 0;
 
-	ASSERT(tlsf->blk_hdr_len == TLSF_BLKHDR_LEN);
-	blk = (tlsf_blk_t *)(void *)((uint8_t *)ptr - TLSF_BLKHDR_LEN);
-	tlsf_ext_free(tlsf, blk);
-}
+	for (unsigned fli = 0; fli < TLSF_FLI_MAX; fli++) {
+		total += profile[fli];
+	}
+	if (total == 0) {
+		return;
+	}
+	for (unsigned fli = 0; fli < TLSF_FLI_MAX; fli++) {
+		if (!class_used_p(tlsf->mbs, tlsf->size, fli)) {
+			density[fli] = 0;
+		} else if (profile[fli] == 0) {
+			density[fli] = TLSF_DENSITY_COLD;
+		} else if (profile[fli] >= total / TLSF_PROFILE_HOT) {
+			density[fli] = hot;
+		} else {
+			density[fli] = TLSF_SLI_SHIFT;
+		}
+	}
+	if (CORE_CALL(tlsf, set_density, (tlsf, density)) == 0) {
+		return;
+	}
 
-uintptr_t
-tlsf_ext_getaddr(const tlsf_blk_t *blk, size_t *length)
-{
-	if (length) {
-		*length = block_length(blk);
+	/* Does not fit: fall back to the default for the hot classes. */
+	for (unsigned fli = 0; fli < TLSF_FLI_MAX; fli++) {
+		density[fli] = MIN(density[fli], TLSF_SLI_SHIFT);
 	}
-	return blk->addr;
+	(void)CORE_CALL(tlsf, set_density, (tlsf, density));
 }
 
 /*
@@ -572,12 +398,41 @@ tlsf_ext_getaddr(const tlsf_blk_t *blk, size_t *length)
  * => If 'mode' is TLSF_INT, then the given base pointer is treated as
  *    accessible memory and the block headers will be inlined in the
  *    allocated blocks of space.
+ *
+ * => If 'mode' is TLSF_HYBRID, then block headers will be externalised,
+ *    as with TLSF_EXT, but the allocations can also be made through the
+ *    tlsf_{alloc,free} API, returning the pointers.  The address index
+ *    is used to find the headers.
  */
 tlsf_t *
 tlsf_create(uintptr_t baseptr, size_t size, unsigned mbs, tlsf_mode_t mode)
 {
-	tlsf_blk_t *blk;
-	tlsf_extblk_t *extblk;
+	return tlsf_create2(baseptr, size, mbs, mode, 0);
+}
+
+/*
+ * tlsf_create2: same as tlsf_create(), but with the additional flags.
+ *
+ * => TLSF_ADDRIDX: maintain the address index of the blocks, so they can
+ *    be looked up by the address in O(log n) time.  With TLSF-INT, the
+ *    index has a page granularity and the blocks within the page are
+ *    walked; therefore, the lookup is bounded by the page size.
+ *
+ * => TLSF_COMPACT: use the 8-byte block headers with TLSF-INT, instead
+ *    of two words.  The space must be smaller than 4 GB.  Note: the data
+ *    is then aligned to 8 bytes.  Ignored with TLSF-EXT or if the regular
+ *    header is not larger (e.g. 32-bit systems).
+ *
+ * => TLSF_ZEROED: the space is zero-filled, e.g. fresh from mmap(2), so
+ *    tlsf_calloc() does not zero it again.  Ignored with the compact
+ *    headers.
+ */
+tlsf_t *
+tlsf_create2(uintptr_t baseptr, size_t size, unsigned mbs, tlsf_mode_t mode,
+    unsigned flags)
+{
+	uint8_t density[TLSF_FLI_MAX];
+	unsigned nslots = 0;
 	tlsf_t *tlsf;
 
 	/* Check the base pointer alignment. */
@@ -594,44 +449,84 @@ tlsf_create(uintptr_t baseptr, size_t size, unsigned mbs, tlsf_mode_t mode)
 	if (size <= mbs)
 		return NULL;
 
+	/*
+	 * Size the map for the first-level classes which can have blocks,
+	 * with the default number of subdivisions; a single list for the
+	 * others, so they do not take the map.  The classes themselves are
+	 * allocated from the MBS class up to the class above the space size.
+	 */
+	for (unsigned fli = 0; fli < TLSF_FLI_MAX; fli++) {
+		density[fli] = 0;
+		if (class_used_p(mbs, size, fli)) {
+			density[fli] = TLSF_SLI_SHIFT;
+			nslots += 1U << MIN(fli, TLSF_SLI_SHIFT);
+		}
+	}
 	tlsf = calloc(1, sizeof(tlsf_t));
 	if (tlsf == NULL)
 		return NULL;
+	tlsf->nclasses = ilog2(size) - ilog2(mbs) + 2;
+	tlsf->classes = calloc(tlsf->nclasses, sizeof(tlsf_class_t));
+	tlsf->map = calloc(nslots, sizeof(tlsf_blk_t *));
+	if (tlsf->classes == NULL || tlsf->map == NULL) {
+		free(tlsf->classes);
+		free(tlsf->map);
+		free(tlsf);
+		return NULL;
+	}
 
 	/* Initialise the TLSF object itself. */
 	tlsf->baseptr = baseptr;
 	tlsf->size = size;
 	tlsf->free = 0;
 	tlsf->mbs = mbs;
+	tlsf->qbudget = UINT_MAX;
 	TAILQ_INIT(&tlsf->blklist);
 
-	/* Initialise and insert the first block. */
+	/*
+	 * Determine the block header layout: it selects the core instance.
+	 */
+	tlsf->mode = mode;
 	switch (mode) {
+	case TLSF_HYBRID:
+		flags |= TLSF_ADDRIDX;
+		/* FALLTHROUGH */
 	case TLSF_EXT:
-		extblk = calloc(1, sizeof(tlsf_extblk_t));
-		if (extblk == NULL) {
-			free(tlsf);
-			return NULL;
-		}
-		blk = &extblk->hdr;
-		blk->addr = baseptr;
-		blk->len = size;
-		TAILQ_INSERT_HEAD(&tlsf->blklist, extblk, entry);
 		tlsf->blk_hdr_len = 0;
 		break;
 	case TLSF_INT:
-		blk = (void *)baseptr;
-		blk->len = size - TLSF_BLKHDR_LEN;
-		blk->prevblk = NULL;
 		tlsf->blk_hdr_len = TLSF_BLKHDR_LEN;
+		if ((flags & TLSF_COMPACT) &&
+		    TLSF_BLKHDR_LEN > TLSF_CBLKHDR_LEN) {
+			if (size > TLSF_CBLK_MAXSIZE)
+				goto err;
+			tlsf->blk_hdr_len = TLSF_CBLKHDR_LEN;
+		}
 		break;
 	default:
-		free(tlsf);
-		return NULL;
+		goto err;
 	}
-	insert_block(tlsf, blk);
+
+	tlsf->nslots = nslots;
+	(void)CORE_CALL(tlsf, set_density, (tlsf, density));
+
+	if (flags & TLSF_ADDRIDX) {
+		tlsf->idx_shift = ilog2(mbs);
+		if (mode == TLSF_INT && tlsf->idx_shift < TLSF_IDX_INT_SHIFT)
+			tlsf->idx_shift = TLSF_IDX_INT_SHIFT;
+		tlsf->addridx = addrmap_create((size - 1) >> tlsf->idx_shift);
+		if (tlsf->addridx == NULL)
+			goto err;
+	}
+
+	/* Initialise and insert the first block. */
+	if (CORE_CALL(tlsf, init, (tlsf, (flags & TLSF_ZEROED) != 0)) == -1)
+		goto err;
 
 	return tlsf;
+err:
+	tlsf_destroy(tlsf);
+	return NULL;
 }
 
 void
@@ -643,9 +538,117 @@ tlsf_destroy(tlsf_t *tlsf)
 		TAILQ_REMOVE(&tlsf->blklist, extblk, entry);
 		free(extblk);
 	}
+	if (tlsf->addridx) {
+		addrmap_destroy(tlsf->addridx);
+	}
+	free(tlsf->htab);
+	free(tlsf->profile);
+	free(tlsf->quick);
+	free(tlsf->map);
+	free(tlsf->classes);
 	free(tlsf);
 }
 
+/*
+ * tlsf_reset: release all the allocations at once, i.e. return the space
+ * to its initial state.  The options and the density are kept.  It is O(1)
+ * with TLSF-INT (unless the address index is used); otherwise, it is linear
+ * in the number of the blocks, as their external headers are released.
+ * Note: all pointers, blocks and handles become invalid.
+ */
+void
+tlsf_reset(tlsf_t *tlsf)
+{
+	free(tlsf->htab);
+	tlsf->htab = NULL;
+	tlsf->hsize = tlsf->hfree = 0;
+	CORE_CALL(tlsf, reset, (tlsf));
+}
+
+/*
+ * tlsf_setopt: set the allocation policy option.  Returns 0 on success
+ * and -1 if the option is not supported or on failure to allocate.
+ *
+ * => TLSF_OPT_GOODFIT: if non-zero, the allocation first scans up to the
+ *    given number of blocks in the size class of the requested size and
+ *    takes the smallest fitting block; only if there is none, it falls
+ *    back to the O(1) search in the next size class.
+ *
+ * => TLSF_OPT_ORDER: the order of the blocks in the free lists, i.e.
+ *    which block of a size class is reused first (see tlsf_order_t).
+ *
+ * => TLSF_OPT_TOPDOWN: if non-zero, the allocations of the given size
+ *    or larger are placed at the high end of the free block, the same
+ *    way as the allocations with the TLSF_LONGLIVED flag.
+ *
+ * => TLSF_OPT_VICTIM: if non-zero, the remainder of the last split is
+ *    kept outside the lists as a designated victim (see insert_remainder).
+ *
+ * => TLSF_OPT_DEFER: if non-zero, the freed small blocks are put on the
+ *    quick lists without merging; a list is coalesced once it has more
+ *    than the given number of blocks.  Zero coalesces all of them.
+ *    The quick lists are allocated once it is first enabled.
+ *
+ * => TLSF_OPT_COALESCE: the maximum number of the deferred blocks to
+ *    coalesce per call; zero means no limit.
+ *
+ * => TLSF_OPT_PROFILE: if non-zero, start collecting the allocation size
+ *    profile; if zero, stop and set the density of the first-level classes
+ *    based on it (see apply_profile).
+ */
+int
+tlsf_setopt(tlsf_t *tlsf, tlsf_opt_t opt, size_t val)
+{
+	switch (opt) {
+	case TLSF_OPT_GOODFIT:
+		tlsf->goodfit = MIN(val, UINT_MAX);
+		break;
+	case TLSF_OPT_ORDER:
+		if (val > TLSF_ORDER_ADDR) {
+			return -1;
+		}
+		tlsf->order = (tlsf_order_t)val;
+		break;
+	case TLSF_OPT_TOPDOWN:
+		tlsf->topdown = val;
+		break;
+	case TLSF_OPT_DEFER:
+		if (val && tlsf->quick == NULL) {
+			tlsf->quick = calloc(TLSF_QUICK_NUM,
+			    sizeof(tlsf_qlist_t));
+			if (tlsf->quick == NULL) {
+				return -1;
+			}
+		}
+		tlsf->qlimit = MIN(val, UINT_MAX);
+		CORE_CALL(tlsf, sync_opts, (tlsf));
+		break;
+	case TLSF_OPT_COALESCE:
+		tlsf->qbudget = val ? MIN(val, UINT_MAX) : UINT_MAX;
+		break;
+	case TLSF_OPT_PROFILE:
+		if (val) {
+			free(tlsf->profile);
+			tlsf->profile = calloc(TLSF_FLI_MAX, sizeof(size_t));
+			if (tlsf->profile == NULL) {
+				return -1;
+			}
+		} else if (tlsf->profile) {
+			apply_profile(tlsf);
+			free(tlsf->profile);
+			tlsf->profile = NULL;
+		}
+		break;
+	case TLSF_OPT_VICTIM:
+		tlsf->usevictim = val != 0;
+		CORE_CALL(tlsf, sync_opts, (tlsf));
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * tlsf_unused_space: return the total unused space.  This is a sum of all
  * free blocks, which is not necessary allocatable, see tlsf_avail_space().
@@ -663,34 +666,5 @@ tlsf_unused_space(tlsf_t *tlsf)
 size_t
 tlsf_avail_space(tlsf_t *tlsf)
 {
-	const unsigned mbs = tlsf->mbs;
-	unsigned fli, sli;
-	tlsf_blk_t *blk;
-	size_t len;
-
-	/*
-	 * Find the last block: look at the highest free FLI and SLI
-	 */
-	if ((fli = flsl(tlsf->l1_free)) == 0) {
-		return 0;
-	}
-	if ((sli = flsl(tlsf->l2_free[--fli])) == 0) {
-		return 0;
-	}
-	blk = tlsf->map[fli][--sli];
-	ASSERT(blk);
-
-	/*
-	 * Get its length.
-	 */
-	ASSERT(validate_blkhdr(tlsf, blk));
-	len = block_length(blk);
-	ASSERT(tlsf_unused_space(tlsf) >= len);
-
-	/*
-	 * Get the previous size class: we want to return the real
-	 * available size on which tls_alloc() would succeed.
-	 */
-	len = roundup2(len + 1, mbs) - mbs;
-	return (len + 1) - (1UL << (ilog2(len) - TLSF_SLI_SHIFT));
+	return CORE_CALL(tlsf, avail_space, (tlsf));
 }
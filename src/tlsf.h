@@ -16,23 +16,96 @@ typedef struct tlsf tlsf_t;
 struct tlsf_blk;
 typedef struct tlsf_blk tlsf_blk_t;
 
+typedef unsigned tlsf_handle_t;
+
+struct tlsf_region;
+typedef struct tlsf_region tlsf_region_t;
+
+struct tlsf_ring;
+typedef struct tlsf_ring tlsf_ring_t;
+
+typedef int (*tlsf_move_func_t)(void *, uintptr_t, uintptr_t, size_t);
+
 typedef enum {
 	TLSF_INT,
 	TLSF_EXT,
+	TLSF_HYBRID,
 } tlsf_mode_t;
 
+/*
+ * Flags for tlsf_create2().
+ */
+#define	TLSF_ADDRIDX		0x01
+#define	TLSF_COMPACT		0x02
+#define	TLSF_ZEROED		0x04
+
+/*
+ * Options for tlsf_setopt().
+ */
+typedef enum {
+	TLSF_OPT_GOODFIT,
+	TLSF_OPT_ORDER,
+	TLSF_OPT_TOPDOWN,
+	TLSF_OPT_VICTIM,
+	TLSF_OPT_DEFER,
+	TLSF_OPT_COALESCE,
+	TLSF_OPT_PROFILE,
+} tlsf_opt_t;
+
+/*
+ * Free list orders, for the TLSF_OPT_ORDER option.
+ */
+typedef enum {
+	TLSF_ORDER_LIFO,
+	TLSF_ORDER_FIFO,
+	TLSF_ORDER_ADDR,
+} tlsf_order_t;
+
+/*
+ * Flags for tlsf_alloc2() and tlsf_ext_alloc2().
+ */
+#define	TLSF_LONGLIVED		0x01
+
 tlsf_t *	tlsf_create(uintptr_t, size_t, unsigned, tlsf_mode_t);
+tlsf_t *	tlsf_create2(uintptr_t, size_t, unsigned, tlsf_mode_t, unsigned);
 void		tlsf_destroy(tlsf_t *);
+void		tlsf_reset(tlsf_t *);
+int		tlsf_setopt(tlsf_t *, tlsf_opt_t, size_t);
+int		tlsf_setdensity(tlsf_t *, size_t, unsigned);
 
 size_t		tlsf_avail_space(tlsf_t *);
 size_t		tlsf_unused_space(tlsf_t *);
 
 void *		tlsf_alloc(tlsf_t *, size_t);
+void *		tlsf_alloc2(tlsf_t *, size_t, unsigned);
+void *		tlsf_calloc(tlsf_t *, size_t, size_t);
 void		tlsf_free(tlsf_t *, void *);
+void *		tlsf_lookup(tlsf_t *, const void *);
+
+tlsf_handle_t	tlsf_handle_alloc(tlsf_t *, size_t);
+void		tlsf_handle_free(tlsf_t *, tlsf_handle_t);
+void *		tlsf_handle_ptr(tlsf_t *, tlsf_handle_t);
+int		tlsf_compact(tlsf_t *, size_t);
+
+tlsf_region_t *	tlsf_region_begin(tlsf_t *, size_t);
+void *		tlsf_region_alloc(tlsf_region_t *, size_t);
+void		tlsf_region_end(tlsf_region_t *);
+
+tlsf_ring_t *	tlsf_ring_create(tlsf_t *, size_t);
+void		tlsf_ring_destroy(tlsf_ring_t *);
+void *		tlsf_ring_alloc(tlsf_ring_t *, size_t);
+void		tlsf_ring_free(tlsf_ring_t *, void *);
 
 tlsf_blk_t *	tlsf_ext_alloc(tlsf_t *, size_t);
+tlsf_blk_t *	tlsf_ext_alloc2(tlsf_t *, size_t, unsigned);
+tlsf_blk_t *	tlsf_ext_alloc_at(tlsf_t *, uintptr_t, size_t);
 void		tlsf_ext_free(tlsf_t *, tlsf_blk_t *);
+int		tlsf_ext_free_addr(tlsf_t *, uintptr_t);
 uintptr_t	tlsf_ext_getaddr(const tlsf_blk_t *, size_t *);
+tlsf_blk_t *	tlsf_ext_lookup(tlsf_t *, uintptr_t);
+int		tlsf_ext_trim(tlsf_t *, tlsf_blk_t *, size_t);
+int		tlsf_ext_extend(tlsf_t *, tlsf_blk_t *, size_t);
+int		tlsf_ext_defrag(tlsf_t *, size_t, tlsf_move_func_t, void *);
 
 __END_DECLS
 
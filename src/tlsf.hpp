@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: header-only C++ front-end.
+ *
+ *	tlsfpp::heap<Mode, SLI, MBS, Lock>
+ *
+ * - Mode: TLSF_INT, TLSF_EXT or TLSF_HYBRID.
+ * - SLI: the number of second-level subdivisions, as an exponent of 2
+ *   (3 to 6); it is set as the density of all first-level classes.  The
+ *   default is TLSF_SLI_SHIFT, if defined (as for the library build),
+ *   otherwise 5, i.e. the default of the library.  Note:
+ *   the map is bounded by the SLI the library is compiled with, therefore
+ *   a larger SLI may not fit the large spaces (see tlsf_setdensity).
+ * - MBS: the minimum block size, a power of 2 of at least 32.
+ * - Lock: a type with lock() and unlock(), e.g. std::mutex; the default
+ *   tlsfpp::null_lock does no locking.
+ *
+ * The heap owns the TLSF object: it is move-only and destroys the object
+ * once it goes out of scope.  The construction throws std::bad_alloc on
+ * failure, while the allocation returns nullptr, as the C API does.
+ *
+ * The adapters for the standard containers, using an existing TLSF-INT
+ * or TLSF-HYBRID object, which is not owned (e.g. heap::get()):
+ *
+ *	tlsfpp::memory_resource: std::pmr::memory_resource, e.g. for the
+ *	    per-request arenas of std::pmr containers; release() resets
+ *	    the whole arena (see tlsf_reset).
+ *	tlsfpp::allocator<T, Tag>: the stateless STL allocator, using the
+ *	    TLSF object bound to the tag with tlsfpp::arena<Tag>::bind().
+ *
+ * Neither does locking: the caller serialises the use of the object.
+ *
+ * If TLSF_CXX_INLINE is defined, then the TLSF-INT allocations use the
+ * inline fast paths (see tlsf_inline.h).  It changes the definitions of
+ * the classes, therefore it must be the same in all translation units of
+ * the program, e.g. set on the command line.  Since the MBS and the
+ * density are the template parameters, the class of the single object
+ * allocations, i.e. allocate<T>(), is computed at compile time for any
+ * configuration; at run time it is only checked that the density was not
+ * changed, e.g. using tlsf_setdensity() on get().
+ */
+
+#ifndef _TLSF_HPP_
+#define _TLSF_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef TLSF_CXX_INLINE
+#include "tlsf_inline.h"
+#else
+#include <sys/cdefs.h>
+#include "tlsf.h"
+#endif
+
+namespace tlsfpp {
+
+#ifdef TLSF_SLI_SHIFT
+constexpr unsigned default_sli = TLSF_SLI_SHIFT;
+#else
+constexpr unsigned default_sli = 5;
+#endif
+
+/*
+ * null_lock: the locking policy for the heaps used by a single thread.
+ */
+struct null_lock {
+	void lock() noexcept {}
+	void unlock() noexcept {}
+};
+
+template <tlsf_mode_t Mode = TLSF_INT, unsigned SLI = default_sli,
+    unsigned MBS = 32, class Lock = null_lock>
+class heap {
+	static_assert(Mode == TLSF_INT || Mode == TLSF_EXT ||
+	    Mode == TLSF_HYBRID, "invalid mode");
+	static_assert(SLI >= 3 && SLI <= 6, "SLI must be in [3 .. 6] range");
+	static_assert(MBS >= 32 && (MBS & (MBS - 1)) == 0,
+	    "MBS must be a power of 2 of at least 32");
+
+public:
+	static constexpr tlsf_mode_t mode = Mode;
+	static constexpr unsigned sli_shift = SLI;
+	static constexpr unsigned mbs = MBS;
+
+	/*
+	 * Construct the heap for the space at the given base address
+	 * (pointer for TLSF-INT and TLSF-HYBRID) of the given length.
+	 */
+	heap(uintptr_t base, size_t size, unsigned flags = 0)
+	{
+		m_tlsf = tlsf_create2(base, size, MBS, Mode, flags);
+		if (m_tlsf == nullptr || set_density() == -1) {
+			reset();
+			throw std::bad_alloc();
+		}
+	}
+
+	heap(void *base, size_t size, unsigned flags = 0) :
+	    heap(reinterpret_cast<uintptr_t>(base), size, flags)
+	{
+		static_assert(Mode != TLSF_EXT,
+		    "TLSF-EXT space is not addressable");
+	}
+
+	heap(const heap &) = delete;
+	heap &operator=(const heap &) = delete;
+
+	/*
+	 * Moving transfers the ownership of the TLSF object; the lock is
+	 * not transferred.  Note: the moved-from heap must not be used.
+	 */
+	heap(heap &&other) noexcept :
+	    m_tlsf(std::exchange(other.m_tlsf, nullptr))
+	{
+	}
+
+	heap &
+	operator=(heap &&other) noexcept
+	{
+		if (this != &other) {
+			reset();
+			m_tlsf = std::exchange(other.m_tlsf, nullptr);
+		}
+		return *this;
+	}
+
+	~heap() { reset(); }
+
+	tlsf_t *get() const noexcept { return m_tlsf; }
+
+	/*
+	 * TLSF-INT and TLSF-HYBRID: allocate and free the memory.
+	 */
+	void *
+	alloc(size_t size) noexcept
+	{
+		static_assert(Mode != TLSF_EXT, "use ext_alloc() for TLSF-EXT");
+		std::lock_guard<Lock> guard(m_lock);
+#ifdef TLSF_CXX_INLINE
+		if constexpr (Mode == TLSF_INT) {
+			return tlsf_alloc_inline(m_tlsf, size);
+		}
+#endif
+		return tlsf_alloc(m_tlsf, size);
+	}
+
+	void
+	free(void *ptr) noexcept
+	{
+		static_assert(Mode != TLSF_EXT, "use ext_free() for TLSF-EXT");
+		std::lock_guard<Lock> guard(m_lock);
+#ifdef TLSF_CXX_INLINE
+		if constexpr (Mode == TLSF_INT) {
+			tlsf_free_inline(m_tlsf, ptr);
+			return;
+		}
+#endif
+		tlsf_free(m_tlsf, ptr);
+	}
+
+	/*
+	 * allocate<T>(n): allocate the memory for 'n' objects of type T.
+	 * The objects are not constructed.  Returns nullptr on failure.
+	 */
+	template <class T>
+	T *
+	allocate(size_t n) noexcept
+	{
+		static_assert(alignof(T) <= alignof(unsigned long),
+		    "over-aligned types are not supported");
+		if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+			return nullptr;
+		}
+		return static_cast<T *>(alloc(n * sizeof(T)));
+	}
+
+	/*
+	 * allocate<T>(): allocate the memory for a single object of type T;
+	 * the size class is resolved at compile time.
+	 */
+	template <class T>
+	T *
+	allocate() noexcept
+	{
+		static_assert(alignof(T) <= alignof(unsigned long),
+		    "over-aligned types are not supported");
+#ifdef TLSF_CXX_INLINE
+		if constexpr (Mode == TLSF_INT) {
+			constexpr size_class c = class_of(sizeof(T));
+			std::lock_guard<Lock> guard(m_lock);
+
+			if (m_tlsf->mbs == MBS && c.size <= m_tlsf->size &&
+			    tlsf_class_shift(m_tlsf, c.sfli) == c.sshift &&
+			    tlsf_class_shift(m_tlsf, c.fli) == c.shift) {
+				return static_cast<T *>(tlsf_alloc_class(m_tlsf,
+				    c.size, c.fli, c.sli));
+			}
+			return static_cast<T *>(
+			    tlsf_alloc_inline(m_tlsf, sizeof(T)));
+		}
+#endif
+		return static_cast<T *>(alloc(sizeof(T)));
+	}
+
+	template <class T>
+	void
+	deallocate(T *ptr, size_t = 1) noexcept
+	{
+		free(static_cast<void *>(ptr));
+	}
+
+	/*
+	 * TLSF-EXT and TLSF-HYBRID: allocate and free the blocks.
+	 */
+	tlsf_blk_t *
+	ext_alloc(size_t size) noexcept
+	{
+		static_assert(Mode != TLSF_INT, "use alloc() for TLSF-INT");
+		std::lock_guard<Lock> guard(m_lock);
+		return tlsf_ext_alloc(m_tlsf, size);
+	}
+
+	void
+	ext_free(tlsf_blk_t *blk) noexcept
+	{
+		static_assert(Mode != TLSF_INT, "use free() for TLSF-INT");
+		std::lock_guard<Lock> guard(m_lock);
+		tlsf_ext_free(m_tlsf, blk);
+	}
+
+	size_t
+	unused_space() noexcept
+	{
+		std::lock_guard<Lock> guard(m_lock);
+		return tlsf_unused_space(m_tlsf);
+	}
+
+	size_t
+	avail_space() noexcept
+	{
+		std::lock_guard<Lock> guard(m_lock);
+		return tlsf_avail_space(m_tlsf);
+	}
+
+private:
+	tlsf_t *	m_tlsf = nullptr;
+	Lock		m_lock;
+
+	void
+	reset() noexcept
+	{
+		if (m_tlsf) {
+			tlsf_destroy(m_tlsf);
+			m_tlsf = nullptr;
+		}
+	}
+
+	static constexpr unsigned
+	log2(size_t x)
+	{
+		unsigned n = 0;
+
+		while (x >>= 1)
+			n++;
+		return n;
+	}
+
+	/*
+	 * set_density: set the SLI as the density of the first-level
+	 * classes, up to the class of the whole free space.
+	 */
+	int
+	set_density() noexcept
+	{
+		const size_t space = tlsf_unused_space(m_tlsf);
+
+		for (unsigned fli = log2(MBS); fli <
+		    std::numeric_limits<size_t>::digits &&
+		    (size_t(1) << fli) <= space; fli++) {
+			if (tlsf_setdensity(m_tlsf,
+			    size_t(1) << fli, 1U << SLI) == -1)
+				return -1;
+		}
+		return 0;
+	}
+
+	/*
+	 * size_class: the size rounded to the MBS, the target class which
+	 * it rounds up to and the widths of the second-level classes,
+	 * computed the same way as the allocator does (see tlsf_get_mapping).
+	 */
+	struct size_class {
+		size_t		size;
+		unsigned	sfli, sshift;
+		unsigned	fli, shift, sli;
+	};
+
+	static constexpr size_class
+	class_of(size_t n)
+	{
+		size_class c{};
+		size_t target = 0;
+
+		c.size = n ? (((n - 1) | (MBS - 1)) + 1) : MBS;
+		c.sfli = log2(c.size);
+		c.sshift = c.sfli - (c.sfli < SLI ? c.sfli : SLI);
+		target = c.size + (size_t(1) << c.sshift) - 1;
+		c.fli = log2(target);
+		c.shift = c.fli - (c.fli < SLI ? c.fli : SLI);
+		c.sli = (target ^ (size_t(1) << c.fli)) >> c.shift;
+		return c;
+	}
+};
+
+/*
+ * aligned_alloc: allocate the memory with the given alignment.  The TLSF
+ * guarantees the word alignment; for a larger one, more memory is taken
+ * and the pointer to it is stored in front of the aligned area.  As with
+ * tlsf_alloc(), returns nullptr for the zero size.
+ */
+inline void *
+aligned_alloc(tlsf_t *tlsf, size_t size, size_t align) noexcept
+{
+	void *ptr;
+
+	if (size == 0) {
+		return nullptr;
+	}
+	if (align <= alignof(void *)) {
+		return tlsf_alloc(tlsf, size);
+	}
+	if (size > std::numeric_limits<size_t>::max() - align) {
+		return nullptr;
+	}
+	if ((ptr = tlsf_alloc(tlsf, size + align)) == nullptr) {
+		return nullptr;
+	}
+	uintptr_t addr = reinterpret_cast<uintptr_t>(ptr) + sizeof(void *);
+	addr = (addr + align - 1) & ~(uintptr_t)(align - 1);
+	reinterpret_cast<void **>(addr)[-1] = ptr;
+	return reinterpret_cast<void *>(addr);
+}
+
+inline void
+aligned_free(tlsf_t *tlsf, void *ptr, size_t align) noexcept
+{
+	if (ptr && align > alignof(void *)) {
+		ptr = static_cast<void **>(ptr)[-1];
+	}
+	tlsf_free(tlsf, ptr);
+}
+
+/*
+ * memory_resource: the polymorphic memory resource backed by the TLSF
+ * object.  The allocation throws std::bad_alloc on failure.
+ */
+class memory_resource : public std::pmr::memory_resource {
+public:
+	explicit memory_resource(tlsf_t *tlsf) noexcept : m_tlsf(tlsf) {}
+
+	tlsf_t *get() const noexcept { return m_tlsf; }
+
+	/*
+	 * release: free all the memory allocated from the resource at
+	 * once.  The containers using it must not be used afterwards,
+	 * except to be destroyed without deallocation (e.g. released).
+	 */
+	void release() noexcept { tlsf_reset(m_tlsf); }
+
+protected:
+	void *
+	do_allocate(size_t bytes, size_t align) override
+	{
+		/* The zero-size request must still get a unique pointer. */
+		void *ptr = aligned_alloc(m_tlsf, bytes ? bytes : 1, align);
+
+		if (ptr == nullptr) {
+			throw std::bad_alloc();
+		}
+		return ptr;
+	}
+
+	void
+	do_deallocate(void *ptr, size_t, size_t align) override
+	{
+		aligned_free(m_tlsf, ptr, align);
+	}
+
+	bool
+	do_is_equal(const std::pmr::memory_resource &other) const
+	    noexcept override
+	{
+		const memory_resource *mr =
+		    dynamic_cast<const memory_resource *>(&other);
+		return mr && mr->m_tlsf == m_tlsf;
+	}
+
+private:
+	tlsf_t *	m_tlsf;
+};
+
+/*
+ * arena<Tag>: the TLSF object used by the allocators of the given tag.
+ * It must be bound before any allocation and it must outlive them.
+ */
+template <class Tag = void>
+struct arena {
+	static inline tlsf_t *tlsf = nullptr;
+
+	static void bind(tlsf_t *t) noexcept { tlsf = t; }
+	static void release() noexcept { tlsf_reset(tlsf); }
+};
+
+template <class T, class Tag = void>
+class allocator {
+public:
+	using value_type = T;
+	using is_always_equal = std::true_type;
+
+	allocator() noexcept = default;
+
+	template <class U>
+	allocator(const allocator<U, Tag> &) noexcept {}
+
+	T *
+	allocate(size_t n)
+	{
+		void *ptr = nullptr;
+
+		if (n <= std::numeric_limits<size_t>::max() / sizeof(T)) {
+			ptr = aligned_alloc(arena<Tag>::tlsf,
+			    n ? n * sizeof(T) : 1, alignof(T));
+		}
+		if (ptr == nullptr) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T *>(ptr);
+	}
+
+	void
+	deallocate(T *ptr, size_t) noexcept
+	{
+		aligned_free(arena<Tag>::tlsf, ptr, alignof(T));
+	}
+};
+
+template <class T, class U, class Tag>
+inline bool
+operator==(const allocator<T, Tag> &, const allocator<U, Tag> &) noexcept
+{
+	return true;
+}
+
+template <class T, class U, class Tag>
+inline bool
+operator!=(const allocator<T, Tag> &, const allocator<U, Tag> &) noexcept
+{
+	return false;
+}
+
+} // namespace tlsfpp
+
+#endif
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: the core instance for TLSF-INT with the compact block headers.
+ */
+
+#define	TLSF_CORE_INT		1
+#define	TLSF_CORE_HDRLEN	TLSF_CBLKHDR_LEN
+#define	TLSF_CORE(name)		core_cint_##name
+
+#include "tlsf_core.c"
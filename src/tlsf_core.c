@@ -0,0 +1,1864 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: the core of the allocator, i.e. the block management and the
+ * allocation algorithm.  This file is compiled once for each block
+ * header layout (see tlsf_int.c, tlsf_cint.c and tlsf_ext.c), which
+ * define the following:
+ *
+ * - TLSF_CORE_INT: 1 for TLSF-INT and 0 for TLSF-EXT (or TLSF-HYBRID).
+ * - TLSF_CORE_HDRLEN: the block header length, zero for TLSF-EXT.
+ * - TLSF_CORE(name): the name of an interface function of the instance.
+ *
+ * The functions of the interface are called by tlsf.c (see tlsf_impl.h),
+ * once it dispatched on the mode.
+ */
+
+#if !defined(TLSF_CORE_INT) || !defined(TLSF_CORE_HDRLEN)
+#error "tlsf_core.c is instantiated by the mode specific files"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "tlsf_impl.h"
+
+/*
+ * The block header length: a constant in the instance.
+ */
+#define	HDR_LEN			TLSF_CORE_HDRLEN
+
+/*
+ * Initial size of the handle table and the maximum number of blocks
+ * visited by a single compaction step.
+ */
+#define	TLSF_HTAB_INIT		64
+#define	TLSF_COMPACT_SCAN	64
+
+/*
+ * The maximum number of blocks visited to find the insertion position
+ * in the address-ordered free list (see TLSF_ORDER_ADDR).
+ */
+#define	TLSF_ORDER_SCAN		16
+
+/*
+ * COMPACT_P: true if the compact block headers are used.
+ */
+#define	COMPACT_P		TLSF_COMPACT_P(HDR_LEN)
+
+/*
+ * ZERO_P: true if the known-zero blocks are tracked (see TLSF_BLK_ZERO).
+ * The size from which tlsf_calloc() uses the non-temporal stores.
+ */
+#define	ZERO_P			(!COMPACT_P)
+#define	TLSF_ZERO_NT_MIN	(256 * 1024)
+
+/*
+ * block_lenflags: return the block length with the flags, i.e. the
+ * 'len' field.
+ */
+static inline size_t
+block_lenflags(const tlsf_t *tlsf __unused, const tlsf_blk_t *blk)
+{
+	ASSERT(tlsf->blk_hdr_len == HDR_LEN);
+	return tlsf_blk_lenflags(blk, COMPACT_P);
+}
+
+static inline void
+block_set_lenflags(const tlsf_t *tlsf __unused, tlsf_blk_t *blk, size_t len)
+{
+	ASSERT(tlsf->blk_hdr_len == HDR_LEN);
+	tlsf_blk_set_lenflags(blk, len, COMPACT_P);
+}
+
+static inline size_t
+block_length(const tlsf_t *tlsf, const tlsf_blk_t *blk)
+{
+	return (block_lenflags(tlsf, blk) & ~TLSF_BLK_FLAGS);
+}
+
+static inline bool
+block_flag_p(const tlsf_t *tlsf, const tlsf_blk_t *blk, size_t flag)
+{
+	return (block_lenflags(tlsf, blk) & flag) != 0;
+}
+
+static inline void
+block_set_flag(const tlsf_t *tlsf, tlsf_blk_t *blk, size_t flag)
+{
+	block_set_lenflags(tlsf, blk, block_lenflags(tlsf, blk) | flag);
+}
+
+static inline void
+block_clear_flag(const tlsf_t *tlsf, tlsf_blk_t *blk, size_t flag)
+{
+	block_set_lenflags(tlsf, blk, block_lenflags(tlsf, blk) & ~flag);
+}
+
+static inline bool
+block_free_p(const tlsf_t *tlsf, const tlsf_blk_t *blk)
+{
+	return block_flag_p(tlsf, blk, TLSF_BLK_FREE);
+}
+
+static inline bool
+block_zero_p(const tlsf_t *tlsf, const tlsf_blk_t *blk)
+{
+	return ZERO_P && block_flag_p(tlsf, blk, TLSF_BLK_ZERO);
+}
+
+static inline bool
+block_used_p(const tlsf_t *tlsf, const tlsf_blk_t *blk)
+{
+	return !block_flag_p(tlsf, blk, TLSF_BLK_FREE | TLSF_BLK_QUICK);
+}
+
+static inline uintptr_t
+block_addr(const tlsf_t *tlsf __unused, const tlsf_blk_t *blk)
+{
+	return HDR_LEN ? (uintptr_t)blk : blk->addr;
+}
+
+static inline uintptr_t
+blkidx_key(const tlsf_t *tlsf, uintptr_t addr)
+{
+	return (addr - tlsf->baseptr) >> tlsf->idx_shift;
+}
+
+/*
+ * get_{prev,next}_physblk: given the block header, return the previous
+ * or next physical block.
+ */
+
+#if TLSF_CORE_INT
+
+static inline tlsf_blk_t *
+get_prev_physblk(const tlsf_t *tlsf __unused, tlsf_blk_t *blk)
+{
+	ASSERT(TAILQ_EMPTY(&tlsf->blklist));
+
+	if (COMPACT_P) {
+		const tlsf_cblk_t *cblk = (void *)blk;
+
+		return cblk->prev ? (void *)((uint8_t *)blk -
+		    ((size_t)cblk->prev << TLSF_CBLK_SHIFT)) : NULL;
+	}
+	return blk->prevblk;
+}
+
+static inline tlsf_blk_t *
+get_next_physblk(const tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	uintptr_t space_end = (uintptr_t)tlsf->baseptr + tlsf->size;
+	uintptr_t nblkptr;
+
+	ASSERT(TAILQ_EMPTY(&tlsf->blklist));
+	nblkptr = (uintptr_t)blk + HDR_LEN + block_length(tlsf, blk);
+	ASSERT(nblkptr <= space_end);
+	return nblkptr < space_end ? (tlsf_blk_t *)nblkptr : NULL;
+}
+
+/*
+ * set_prev_physblk: set the previous physical block (TLSF-INT only).
+ */
+static inline void
+set_prev_physblk(tlsf_blk_t *blk, tlsf_blk_t *prevblk)
+{
+	if (COMPACT_P) {
+		tlsf_cblk_t *cblk = (void *)blk;
+
+		ASSERT(prevblk == NULL || prevblk < blk);
+		cblk->prev = prevblk ? (uint32_t)(((uintptr_t)blk -
+		    (uintptr_t)prevblk) >> TLSF_CBLK_SHIFT) : 0;
+		return;
+	}
+	blk->prevblk = prevblk;
+}
+
+#else
+
+static inline tlsf_blk_t *
+get_prev_physblk(const tlsf_t *tlsf __unused, tlsf_blk_t *blk)
+{
+	tlsf_extblk_t *extblk = (void *)blk;
+	return (void *)TAILQ_PREV(extblk, tlsf_extblk_qh, entry);
+}
+
+static inline tlsf_blk_t *
+get_next_physblk(const tlsf_t *tlsf __unused, tlsf_blk_t *blk)
+{
+	tlsf_extblk_t *extblk = (void *)blk;
+	return (void *)TAILQ_NEXT(extblk, entry);
+}
+
+#endif
+
+#ifndef NDEBUG
+/*
+ * validate_blkhdr: diagnostic function to validate the consistency of
+ * the given block header and pointers to its physical neighbours.
+ */
+static bool
+validate_blkhdr(const tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	const uintptr_t addr = block_addr(tlsf, blk);
+	const uintptr_t space_start = tlsf->baseptr;
+	const uintptr_t space_end = tlsf->baseptr + tlsf->size;
+	tlsf_blk_t *nextblk = get_next_physblk(tlsf, blk);
+	tlsf_blk_t *prevblk = get_prev_physblk(tlsf, blk);
+	const size_t blen = block_length(tlsf, blk);
+
+	/* The block should be at least MBS, but not more than total. */
+	ASSERT(blen >= tlsf->mbs);
+	ASSERT(blen <= tlsf->size);
+
+	/* The block should be within the boundaries. */
+	ASSERT(addr >= space_start);
+	ASSERT(addr < space_end);
+
+	/*
+	 * The "next" (based on calculation) of the previous block should
+	 * point to us and the next block should have a link to us.  Unless
+	 * this is the first or the last physical block respectively.
+	 */
+	ASSERT(addr == space_start || get_next_physblk(tlsf, prevblk) == blk);
+	ASSERT(!nextblk || get_prev_physblk(tlsf, nextblk) == blk);
+
+	/*
+	 * If indexed, the index should point to us or the preceding block
+	 * within the same granule.
+	 */
+	if (tlsf->addridx) {
+		const uintptr_t key = blkidx_key(tlsf, addr);
+		tlsf_blk_t *idxblk = addrmap_get(tlsf->addridx, key);
+
+		ASSERT(idxblk != NULL);
+		ASSERT(block_addr(tlsf, idxblk) <= addr);
+		ASSERT(blkidx_key(tlsf, block_addr(tlsf, idxblk)) == key);
+	}
+	return true;
+}
+#endif
+
+/*
+ * blkidx_insert: add the block to the address index, unless there is
+ * a preceding block within the same granule.  Returns 0 on success and
+ * -1 on failure.
+ */
+static int
+blkidx_insert(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	const uintptr_t addr = block_addr(tlsf, blk);
+	const uintptr_t key = blkidx_key(tlsf, addr);
+	tlsf_blk_t *idxblk;
+
+	idxblk = addrmap_get(tlsf->addridx, key);
+	if (idxblk && block_addr(tlsf, idxblk) < addr) {
+		return 0;
+	}
+	return addrmap_set(tlsf->addridx, key, blk);
+}
+
+/*
+ * blkidx_remove: remove the block from the address index.  If it was
+ * the first block within the granule, then the next block takes its
+ * place, if it starts within the same granule.
+ *
+ * => Must be called while the block is still in the physical chain.
+ */
+static void
+blkidx_remove(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	const uintptr_t key = blkidx_key(tlsf, block_addr(tlsf, blk));
+	tlsf_blk_t *nextblk;
+
+	if (addrmap_get(tlsf->addridx, key) != blk) {
+		return;
+	}
+	nextblk = get_next_physblk(tlsf, blk);
+	if (nextblk && blkidx_key(tlsf, block_addr(tlsf, nextblk)) == key) {
+		/* The slot exists: the replacement cannot fail. */
+		(void)addrmap_set(tlsf->addridx, key, nextblk);
+	} else {
+		addrmap_del(tlsf->addridx, key);
+	}
+}
+
+#if TLSF_CORE_INT
+/*
+ * blkidx_move: update the address index when the block start moves from
+ * the old to the new address, with no other block in-between.  Returns
+ * 0 on success and -1 on failure, in which case the index is unchanged.
+ *
+ * => Must be called while the old block is still in the physical chain.
+ */
+static int
+blkidx_move(tlsf_t *tlsf, tlsf_blk_t *oldblk, tlsf_blk_t *newblk)
+{
+	const uintptr_t key = blkidx_key(tlsf, block_addr(tlsf, oldblk));
+
+	if (key == blkidx_key(tlsf, block_addr(tlsf, newblk))) {
+		/* Same granule: just replace, if it is the first block. */
+		if (addrmap_get(tlsf->addridx, key) == oldblk) {
+			(void)addrmap_set(tlsf->addridx, key, newblk);
+		}
+		return 0;
+	}
+	if (blkidx_insert(tlsf, newblk) == -1) {
+		return -1;
+	}
+	blkidx_remove(tlsf, oldblk);
+	return 0;
+}
+#endif
+
+/*
+ * blkidx_lookup: return the block containing the given address, using
+ * the address index.  The first block of the granule is looked up and
+ * then the physical chain is walked within the granule.
+ */
+static tlsf_blk_t *
+blkidx_lookup(tlsf_t *tlsf, uintptr_t addr)
+{
+	const uintptr_t key = blkidx_key(tlsf, addr);
+	tlsf_blk_t *blk, *nextblk;
+
+	blk = addrmap_get_le(tlsf->addridx, key);
+	if (blk && block_addr(tlsf, blk) > addr) {
+		/* The block is in one of the preceding granules. */
+		blk = key ? addrmap_get_le(tlsf->addridx, key - 1) : NULL;
+	}
+	if (__predict_false(blk == NULL)) {
+		return NULL;
+	}
+	while ((nextblk = get_next_physblk(tlsf, blk)) != NULL &&
+	    block_addr(tlsf, nextblk) <= addr) {
+		blk = nextblk;
+	}
+	return blk;
+}
+
+static inline tlsf_blk_t *
+block_hdr_alloc(tlsf_t *tlsf, tlsf_blk_t *parent, size_t len)
+{
+	tlsf_blk_t *blk;
+#if TLSF_CORE_INT
+	const size_t plen = block_length(tlsf, parent);
+	tlsf_blk_t *nblk;
+
+	/*
+	 * Acquire area after the parent for the block header
+	 * and set the length before calculating the pointers.
+	 */
+	blk = (void *)((uint8_t *)parent + HDR_LEN + plen);
+	if (tlsf->addridx && blkidx_insert(tlsf, blk) == -1) {
+		return NULL;
+	}
+	block_set_lenflags(tlsf, blk, len);
+
+	/*
+	 * Set the previous *physical* block pointers: both for our
+	 * block and the block after the newly created block.
+	 */
+	set_prev_physblk(blk, parent);
+	nblk = get_next_physblk(tlsf, blk);
+	if (nblk) {
+		set_prev_physblk(nblk, blk);
+	}
+#else
+	tlsf_extblk_t *extblk, *pextblk = (void *)parent;
+
+	if ((extblk = malloc(sizeof(tlsf_extblk_t))) == NULL) {
+		return NULL;
+	}
+	blk = &extblk->hdr;
+	blk->len = len;
+	blk->addr = parent->addr + block_length(tlsf, parent);
+	if (tlsf->addridx && blkidx_insert(tlsf, blk) == -1) {
+		free(extblk);
+		return NULL;
+	}
+	TAILQ_INSERT_AFTER(&tlsf->blklist, pextblk, extblk, entry);
+#endif
+	return blk;
+}
+
+static inline void
+block_hdr_free(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	ASSERT(!block_free_p(tlsf, blk));
+
+	if (tlsf->addridx) {
+		blkidx_remove(tlsf, blk);
+	}
+	if (tlsf->compact_cur == blk) {
+		/* The block is being merged into the previous one. */
+		tlsf->compact_cur = get_prev_physblk(tlsf, blk);
+	}
+#if TLSF_CORE_INT
+	tlsf_blk_t *nextblk;
+
+	if ((nextblk = get_next_physblk(tlsf, blk)) != NULL) {
+		set_prev_physblk(nextblk, get_prev_physblk(tlsf, blk));
+		ASSERT(validate_blkhdr(tlsf, nextblk));
+	}
+	ASSERT(memset(blk, 0, sizeof(tlsf_blk_t)));
+#else
+	tlsf_extblk_t *extblk = (void *)blk;
+
+	TAILQ_REMOVE(&tlsf->blklist, extblk, entry);
+	ASSERT(memset(extblk, 0, sizeof(tlsf_extblk_t)));
+	free(extblk);
+#endif
+}
+
+/*
+ * find_insert_pos: find the block in front of which the given block
+ * should be inserted, according to the free list order policy.  NULL
+ * means the tail of the list.
+ *
+ * => The address order is approximated: the head and the tail are
+ *    checked first, then at most TLSF_ORDER_SCAN blocks are visited.
+ *    If no position is found, the block is inserted after the last
+ *    visited block, so the list remains mostly sorted.
+ */
+static tlsf_blk_t *
+find_insert_pos(const tlsf_t *tlsf, tlsf_blk_t *head, const tlsf_blk_t *blk)
+{
+	const uintptr_t addr = block_addr(tlsf, blk);
+	unsigned nscan = TLSF_ORDER_SCAN;
+	tlsf_blk_t *pos;
+
+	switch (tlsf->order) {
+	case TLSF_ORDER_FIFO:
+		return NULL;
+	case TLSF_ORDER_ADDR:
+		break;
+	default:
+		return head;
+	}
+	if (addr < block_addr(tlsf, head)) {
+		return head;
+	}
+	if (addr > block_addr(tlsf, head->prev)) {
+		return NULL;
+	}
+	for (pos = head->next; pos && --nscan; pos = pos->next) {
+		if (addr < block_addr(tlsf, pos)) {
+			break;
+		}
+	}
+	return pos;
+}
+
+static void
+insert_block(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	tlsf_blk_t **headp, *head, *pos;
+	unsigned fli, sli;
+
+	ASSERT(validate_blkhdr(tlsf, blk));
+	ASSERT(!block_free_p(tlsf, blk));
+
+	/*
+	 * Get the FLI/SLI and insert the block in front of the position
+	 * given by the order policy or, if none, append to the tail.
+	 */
+	tlsf_get_mapping(tlsf, block_length(tlsf, blk), &fli, &sli);
+	headp = map_slot(tlsf, fli, sli);
+	if ((head = *headp) == NULL) {
+		blk->prev = blk;
+		blk->next = NULL;
+		*headp = blk;
+	} else if ((pos = find_insert_pos(tlsf, head, blk)) == NULL) {
+		blk->prev = head->prev;
+		blk->next = NULL;
+		head->prev->next = blk;
+		head->prev = blk;
+	} else {
+		blk->prev = pos->prev;
+		blk->next = pos;
+		if (pos == head) {
+			*headp = blk;
+		} else {
+			pos->prev->next = blk;
+		}
+		pos->prev = blk;
+	}
+
+	/* Mark the block as free. */
+	tlsf->free += block_length(tlsf, blk);
+	block_set_flag(tlsf, blk, TLSF_BLK_FREE);
+
+	/* Finally, indicate that the lists have free blocks. */
+	tlsf->l1_free |= (1UL << fli);
+	tlsf_fl_class(tlsf, fli)->l2_free |= (UINT64_C(1) << sli);
+}
+
+/*
+ * take_victim: detach the designated victim, clearing its free flag.
+ */
+static inline tlsf_blk_t *
+take_victim(tlsf_t *tlsf)
+{
+	tlsf_blk_t *blk = tlsf->victim;
+
+	ASSERT(block_free_p(tlsf, blk));
+	tlsf->victim = NULL;
+	block_clear_flag(tlsf, blk, TLSF_BLK_FREE);
+	tlsf->free -= block_length(tlsf, blk);
+	return blk;
+}
+
+/*
+ * quick_remove: unlink the block from its quick list, clearing the flags.
+ */
+static tlsf_blk_t *
+quick_remove(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	const unsigned idx = block_length(tlsf, blk) / tlsf->mbs - 1;
+
+	ASSERT(idx < TLSF_QUICK_NUM);
+	ASSERT(!block_free_p(tlsf, blk));
+	ASSERT(block_flag_p(tlsf, blk, TLSF_BLK_QUICK));
+
+	if (blk->next) {
+		blk->next->prev = blk->prev;
+	}
+	if (blk->prev) {
+		blk->prev->next = blk->next;
+	} else {
+		ASSERT(tlsf->quick[idx].head == blk);
+		tlsf->quick[idx].head = blk->next;
+	}
+	if (--tlsf->quick[idx].count == 0) {
+		tlsf->quick_map &= ~(1UL << idx);
+	}
+	block_clear_flag(tlsf, blk, TLSF_BLK_QUICK);
+	tlsf->free -= block_length(tlsf, blk);
+	return blk;
+}
+
+static tlsf_blk_t *
+remove_block(tlsf_t *tlsf, tlsf_blk_t *target, unsigned fli, unsigned sli)
+{
+	tlsf_blk_t **headp, *blk = target;
+	tlsf_class_t *fc;
+
+	/*
+	 * Take a block from the map, unless explicitly specified.
+	 * The designated victim is not on the lists (e.g. it is being
+	 * merged with a neighbour), just detach it.
+	 */
+	if (target && target == tlsf->victim) {
+		return take_victim(tlsf);
+	}
+	fc = tlsf_fl_class(tlsf, fli);
+	headp = &fc->row[sli];
+	if (!target) {
+		blk = *headp;
+		ASSERT(blk);
+	}
+
+	/*
+	 * Unlink the block.  Note: the 'prev' of the head is the tail.
+	 */
+	if (blk->next) {
+		blk->next->prev = blk->prev;
+	} else if (*headp != blk) {
+		(*headp)->prev = blk->prev;
+	}
+	if (*headp == blk) {
+		*headp = blk->next;
+	} else {
+		blk->prev->next = blk->next;
+	}
+
+	/* Clear the free flag. */
+	ASSERT(block_free_p(tlsf, blk));
+	block_clear_flag(tlsf, blk, TLSF_BLK_FREE);
+	tlsf->free -= block_length(tlsf, blk);
+
+	/*
+	 * Last block in SL?  Clear the "free" flag.  If there are SL
+	 * lists with free blocks in the FL class - clear the FL too.
+	 * Note: the removed block is not necessarily the head.
+	 */
+	if (*headp == NULL) {
+		fc->l2_free &= ~(UINT64_C(1) << sli);
+		if (fc->l2_free == 0) {
+			tlsf->l1_free &= ~(1UL << fli);
+		}
+	}
+	ASSERT(validate_blkhdr(tlsf, blk));
+	return blk;
+}
+
+static inline tlsf_blk_t *
+split_block(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+{
+	const size_t zero = block_lenflags(tlsf, blk) & TLSF_BLK_ZERO;
+	tlsf_blk_t *remblk;
+	size_t remsize;
+
+	/* Calculate the remaining size and set the new size. */
+	remsize = block_length(tlsf, blk) - HDR_LEN - size;
+	ASSERT((remsize & TLSF_BLK_FREE) == 0);
+	ASSERT((size & TLSF_BLK_FREE) == 0);
+	block_set_lenflags(tlsf, blk, size | zero);
+
+	/*
+	 * Allocate a new block, inheriting the remaining memory
+	 * from the parent block, as well as its known-zero flag.
+	 */
+	remblk = block_hdr_alloc(tlsf, blk, remsize);
+	if (remblk) {
+		ASSERT(!block_free_p(tlsf, blk));
+		ASSERT(!block_free_p(tlsf, remblk));
+		if (zero) {
+			block_set_flag(tlsf, remblk, TLSF_BLK_ZERO);
+		}
+	} else {
+		block_set_lenflags(tlsf, blk, (size + remsize) | zero);
+	}
+	return remblk;
+}
+
+/*
+ * insert_remainder: insert the remainder of a split block.  If enabled,
+ * make it the designated victim instead, returning the previous one to
+ * the lists.  The victim serves the following allocations, if they fit,
+ * so the consecutive allocations are placed next to each other.
+ */
+static inline void
+insert_remainder(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	if (!tlsf->usevictim) {
+		insert_block(tlsf, blk);
+		return;
+	}
+	if (tlsf->victim) {
+		insert_block(tlsf, take_victim(tlsf));
+	}
+	ASSERT(!block_free_p(tlsf, blk));
+	tlsf->free += block_length(tlsf, blk);
+	block_set_flag(tlsf, blk, TLSF_BLK_FREE);
+	tlsf->victim = blk;
+}
+
+/*
+ * merge_blocks: merge two physically adjacent blocks - the target block
+ * and a block next to it.
+ */
+static inline tlsf_blk_t *
+merge_blocks(tlsf_t *tlsf, tlsf_blk_t *blk, tlsf_blk_t *blk2)
+{
+	const size_t addlen = block_length(tlsf, blk2);
+	const bool zero = block_zero_p(tlsf, blk) && block_zero_p(tlsf, blk2);
+	unsigned fli, sli;
+
+	ASSERT(validate_blkhdr(tlsf, blk));
+	ASSERT(validate_blkhdr(tlsf, blk2));
+
+	/* Ensure that both blocks are removed from the list. */
+	if (block_free_p(tlsf, blk)) {
+		tlsf_get_mapping(tlsf, block_length(tlsf, blk), &fli, &sli);
+		(void)remove_block(tlsf, blk, fli, sli);
+	}
+	if (block_free_p(tlsf, blk2)) {
+		tlsf_get_mapping(tlsf, addlen, &fli, &sli);
+		(void)remove_block(tlsf, blk2, fli, sli);
+	}
+
+	/*
+	 * Add the extra space to the first block.  Finally,
+	 * remove and destroy the second block.
+	 */
+	block_set_lenflags(tlsf, blk, (block_lenflags(tlsf, blk) +
+	    HDR_LEN + addlen) & ~(zero ? 0 : TLSF_BLK_ZERO));
+	block_hdr_free(tlsf, blk2);
+
+	/*
+	 * TLSF-INT: if both were zero-filled, then keep the result so by
+	 * clearing the header and the list entries of the second block.
+	 */
+	if (HDR_LEN && zero) {
+		memset(blk2, 0, sizeof(tlsf_blk_t));
+	}
+	return blk;
+}
+
+/*
+ * free_block: merge the block with the free adjacent blocks and insert
+ * the result into the lists.
+ */
+static void
+free_block(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	tlsf_blk_t *prevblk, *nextblk;
+
+	ASSERT(block_used_p(tlsf, blk));
+
+	/* Get the adjacent blocks. */
+	prevblk = get_prev_physblk(tlsf, blk);
+	nextblk = get_next_physblk(tlsf, blk);
+
+	/*
+	 * Try to merge adjacent blocks.
+	 */
+	if (prevblk && block_free_p(tlsf, prevblk)) {
+		blk = merge_blocks(tlsf, prevblk, blk);
+	}
+	if (nextblk && block_free_p(tlsf, nextblk)) {
+		blk = merge_blocks(tlsf, blk, nextblk);
+	}
+	insert_block(tlsf, blk);
+}
+
+/*
+ * quick_coalesce: take at most the given number of blocks from the
+ * quick lists (all lists, if the index is negative) and coalesce them.
+ * Returns the number of blocks coalesced.
+ */
+static unsigned
+quick_coalesce(tlsf_t *tlsf, int idx, unsigned n)
+{
+	unsigned count = 0;
+
+	while (count < n) {
+		const unsigned long qmap = idx < 0 ?
+		    tlsf->quick_map : tlsf->quick_map & (1UL << idx);
+
+		if (qmap == 0) {
+			break;
+		}
+		free_block(tlsf, quick_remove(tlsf,
+		    tlsf->quick[ffsl(qmap) - 1].head));
+		count++;
+	}
+	return count;
+}
+
+/*
+ * quick_insert: defer the coalescing of the block by putting it on the
+ * quick list, if it is small enough.  If the list overflows, coalesce
+ * its blocks, bounded by the per-call budget.  Returns true on success.
+ */
+static bool
+quick_insert(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	const unsigned idx = block_length(tlsf, blk) / tlsf->mbs - 1;
+	tlsf_blk_t *head;
+
+	if (idx >= TLSF_QUICK_NUM) {
+		return false;
+	}
+	if ((head = tlsf->quick[idx].head) != NULL) {
+		head->prev = blk;
+	}
+	blk->prev = NULL;
+	blk->next = head;
+	tlsf->quick[idx].head = blk;
+	tlsf->quick_map |= 1UL << idx;
+
+	tlsf->free += block_length(tlsf, blk);
+	block_set_flag(tlsf, blk, TLSF_BLK_QUICK);
+
+	if (++tlsf->quick[idx].count > tlsf->qlimit) {
+		quick_coalesce(tlsf, idx, tlsf->qbudget);
+	}
+	return true;
+}
+
+/*
+ * quick_flush: if the block is on a quick list, then coalesce the list,
+ * so the block is merged with its free neighbours and it is on the free
+ * lists.  Returns true if so; the block may have been merged into the
+ * preceding block, therefore the caller has to look it up again.
+ */
+static bool
+quick_flush(tlsf_t *tlsf, const tlsf_blk_t *blk)
+{
+	if (!block_flag_p(tlsf, blk, TLSF_BLK_QUICK)) {
+		return false;
+	}
+	quick_coalesce(tlsf, block_length(tlsf, blk) / tlsf->mbs - 1,
+	    UINT_MAX);
+	return true;
+}
+
+/*
+ * find_goodfit: look for a fitting block in the size class of the size
+ * itself, scanning at most the configured number of blocks.  The smallest
+ * fitting block is taken; an exact fit ends the scan.  Returns the block
+ * removed from the list or NULL if there is no fit.
+ */
+static tlsf_blk_t *
+find_goodfit(tlsf_t *tlsf, size_t size)
+{
+	unsigned fli, sli, nscan = tlsf->goodfit;
+	tlsf_blk_t *blk, *best = NULL;
+
+	tlsf_get_mapping(tlsf, size, &fli, &sli);
+	if ((tlsf_fl_class(tlsf, fli)->l2_free & (UINT64_C(1) << sli)) == 0) {
+		return NULL;
+	}
+	for (blk = *map_slot(tlsf, fli, sli); blk && nscan--; blk = blk->next) {
+		const size_t len = block_length(tlsf, blk);
+
+		if (len < size || (best && len >= block_length(tlsf, best))) {
+			continue;
+		}
+		best = blk;
+		if (len == size) {
+			break;
+		}
+	}
+	return best ? remove_block(tlsf, best, fli, sli) : NULL;
+}
+
+/*
+ * alloc_split: split the block taken for the allocation of the given
+ * size, if it is larger than the threshold, and put the remainder back.
+ * Returns the allocated block.
+ *
+ * Top-down placement (long-lived or large allocations): carve the
+ * allocation from the high end, so the remainder stays at the low end.
+ * Note: keep the remainder length aligned to MBS.
+ */
+static tlsf_blk_t *
+alloc_split(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size, unsigned flags)
+{
+	const unsigned mbs = tlsf->mbs;
+	tlsf_blk_t *remblk;
+	bool topdown;
+
+	ASSERT(block_length(tlsf, blk) >= size);
+
+	if ((block_length(tlsf, blk) - size) < (mbs + HDR_LEN)) {
+		return blk;
+	}
+	topdown = (flags & TLSF_LONGLIVED) != 0 ||
+	    (tlsf->topdown && size >= tlsf->topdown);
+	if (topdown) {
+		const size_t remsize = (block_length(tlsf, blk) -
+		    HDR_LEN - size) & ~((size_t)mbs - 1);
+
+		if ((remblk = split_block(tlsf, blk, remsize)) != NULL) {
+			insert_remainder(tlsf, blk);
+			blk = remblk;
+		}
+	} else if ((remblk = split_block(tlsf, blk, size)) != NULL) {
+		insert_remainder(tlsf, remblk);
+	}
+	return blk;
+}
+
+/*
+ * alloc: take a free block of at least the given size and split off
+ * the remainder, if it is large enough.  Returns NULL on failure.
+ *
+ * => The zero size is not allocated (NULL is returned), nor is the size
+ *    larger than the space, which would not round up to the MBS.
+ */
+tlsf_blk_t *
+TLSF_CORE(alloc)(tlsf_t *tlsf, size_t size, unsigned flags)
+{
+	const unsigned mbs = tlsf->mbs;
+	bool coalesced = false;
+	unsigned fli, sli;
+	tlsf_blk_t *blk;
+	size_t target;
+
+	if (__predict_false(size == 0 || size > tlsf->size)) {
+		return NULL;
+	}
+	size = roundup2(size, mbs);
+	if (__predict_false(tlsf->profile != NULL)) {
+		tlsf->profile[ilog2(size)]++;
+	}
+
+	/*
+	 * Deferred coalescing: take a block from the quick list, if any.
+	 * It is small enough not to be split.
+	 */
+	if (tlsf->quick_map && size / mbs <= TLSF_QUICK_NUM) {
+		const unsigned idx = size / mbs - 1;
+
+		if ((blk = tlsf->quick[idx].head) != NULL) {
+			return quick_remove(tlsf, blk);
+		}
+	}
+
+	/*
+	 * If the designated victim fits, then take it: bump-style split.
+	 *
+	 * Good-fit policy: first, look for a fitting block in the class
+	 * of the size itself, before rounding up to the next class.
+	 */
+	if (tlsf->victim && block_length(tlsf, tlsf->victim) >= size) {
+		blk = take_victim(tlsf);
+		goto found;
+	}
+	if (tlsf->goodfit && (blk = find_goodfit(tlsf, size)) != NULL) {
+		goto found;
+	}
+
+	/*
+	 * Round up the size to MBS and then the next size class.
+	 * Get the FL/SL indexes of the size.
+	 */
+retry:
+	target = size + (1UL << tlsf_class_shift(tlsf, ilog2(size))) - 1;
+	tlsf_get_mapping(tlsf, target, &fli, &sli);
+
+	/*
+	 * Find a free block.  Fast path: look at the current FLI.
+	 * Otherwise, look at next FLI starting with zero SLI.
+	 */
+	sli = ffs64(tlsf_fl_class(tlsf, fli)->l2_free & (UINT64_MAX << sli));
+	if (sli == 0) {
+		fli = ffsl(tlsf->l1_free & (~0UL << ++fli));
+		if (__predict_false(fli == 0)) {
+			/*
+			 * Miss: coalesce a batch of the deferred blocks,
+			 * bounded by the budget, and retry once.
+			 */
+			if (!coalesced && tlsf->quick_map &&
+			    quick_coalesce(tlsf, -1, tlsf->qbudget)) {
+				coalesced = true;
+				goto retry;
+			}
+			return NULL;
+		}
+		sli = ffs64(tlsf_fl_class(tlsf, --fli)->l2_free);
+		ASSERT(sli != 0);
+	}
+	sli--;
+
+	/*
+	 * Remove a block from the list.
+	 */
+	blk = remove_block(tlsf, NULL, fli, sli);
+	ASSERT(blk != NULL);
+found:
+	blk = alloc_split(tlsf, blk, size, flags);
+
+	/*
+	 * The allocated blocks do not have the known-zero flag: it is
+	 * only kept for tlsf_calloc(), see block_zero_fill().
+	 */
+	if ((flags & TLSF_ALLOC_ZERO) == 0 && block_zero_p(tlsf, blk)) {
+		block_clear_flag(tlsf, blk, TLSF_BLK_ZERO);
+	}
+	return blk;
+}
+
+/*
+ * zero_fill: zero the memory.  The large ranges use the non-temporal
+ * stores, so that they do not evict the cache.
+ */
+static void
+zero_fill(void *ptr, size_t len)
+{
+#if defined(__SSE2__)
+	if (len >= TLSF_ZERO_NT_MIN) {
+		const __m128i z = _mm_setzero_si128();
+		const size_t head = -(uintptr_t)ptr & 15;
+		uint8_t *p = ptr;
+
+		memset(p, 0, head);
+		p += head;
+		len -= head;
+		for (; len >= 64; len -= 64, p += 64) {
+			__m128i *v = (void *)p;
+
+			_mm_stream_si128(&v[0], z);
+			_mm_stream_si128(&v[1], z);
+			_mm_stream_si128(&v[2], z);
+			_mm_stream_si128(&v[3], z);
+		}
+		_mm_sfence();
+		memset(p, 0, len);
+		return;
+	}
+#endif
+	memset(ptr, 0, len);
+}
+
+/*
+ * block_zero_fill: zero the data of the allocated block, clearing its
+ * known-zero flag.  If the block has it, then only the list entries,
+ * which the free TLSF-INT block held, are cleared.
+ */
+static void
+block_zero_fill(tlsf_t *tlsf, tlsf_blk_t *blk, void *ptr, size_t size)
+{
+	if (block_zero_p(tlsf, blk)) {
+		block_clear_flag(tlsf, blk, TLSF_BLK_ZERO);
+		if (HDR_LEN) {
+			memset(ptr, 0, MIN(size, sizeof(tlsf_blk_t) - HDR_LEN));
+		}
+		return;
+	}
+	zero_fill(ptr, size);
+}
+
+/*
+ * find_block: return the block containing the given address.  Uses the
+ * address index, if enabled; otherwise, walks the physical chain.
+ */
+static tlsf_blk_t *
+find_block(tlsf_t *tlsf, uintptr_t addr)
+{
+	tlsf_blk_t *blk;
+
+	if (addr < tlsf->baseptr || addr >= tlsf->baseptr + tlsf->size) {
+		return NULL;
+	}
+	if (tlsf->addridx) {
+		return blkidx_lookup(tlsf, addr);
+	}
+	blk = HDR_LEN ?
+	    (void *)tlsf->baseptr : (void *)TAILQ_FIRST(&tlsf->blklist);
+	while (blk) {
+		const uintptr_t blkend = block_addr(tlsf, blk) +
+		    HDR_LEN + block_length(tlsf, blk);
+
+		if (addr < blkend)
+			break;
+		blk = get_next_physblk(tlsf, blk);
+	}
+	return blk;
+}
+
+#if !TLSF_CORE_INT
+/*
+ * alloc_at: allocate the given (non-empty) range, see tlsf_ext_alloc_at().
+ */
+tlsf_blk_t *
+TLSF_CORE(alloc_at)(tlsf_t *tlsf, uintptr_t addr, size_t size)
+{
+	const uintptr_t space_end = tlsf->baseptr + tlsf->size;
+	const unsigned mbs = tlsf->mbs;
+	bool coalesced = false;
+	tlsf_blk_t *blk, *remblk;
+	uintptr_t start, end;
+	unsigned fli, sli;
+
+	ASSERT(size != 0);
+	if (addr < tlsf->baseptr || addr >= space_end ||
+	    size > (space_end - addr)) {
+		return NULL;
+	}
+
+	/*
+	 * Round the range to the MBS boundaries (relative to the base).
+	 */
+	start = tlsf->baseptr +
+	    ((addr - tlsf->baseptr) & ~(uintptr_t)(mbs - 1));
+	end = tlsf->baseptr + roundup2(addr + size - tlsf->baseptr, mbs);
+	ASSERT(end <= space_end);
+
+	/*
+	 * Find the block containing the start of the range.  It must
+	 * be free and contain the whole range.  If its coalescing was
+	 * deferred, then coalesce it first and look it up again.
+	 */
+retry:
+	if ((blk = find_block(tlsf, start)) == NULL) {
+		return NULL;
+	}
+	if (quick_flush(tlsf, blk)) {
+		goto retry;
+	}
+	if (block_used_p(tlsf, blk)) {
+		return NULL;
+	}
+	if (end > blk->addr + block_length(tlsf, blk)) {
+		/*
+		 * Miss: the range may span the deferred blocks.  Coalesce
+		 * a batch of them, bounded by the budget, and retry once.
+		 */
+		if (!coalesced && tlsf->quick_map &&
+		    quick_coalesce(tlsf, -1, tlsf->qbudget)) {
+			coalesced = true;
+			goto retry;
+		}
+		return NULL;
+	}
+	tlsf_get_mapping(tlsf, block_length(tlsf, blk), &fli, &sli);
+	blk = remove_block(tlsf, blk, fli, sli);
+
+	/*
+	 * Split off the head, if any, and put it back as a free block.
+	 */
+	if (start > blk->addr) {
+		if ((remblk = split_block(tlsf, blk, start - blk->addr)) == NULL) {
+			insert_block(tlsf, blk);
+			return NULL;
+		}
+		insert_block(tlsf, blk);
+		blk = remblk;
+	}
+	ASSERT(blk->addr == start);
+
+	/*
+	 * Split off the tail, if any.  On failure, release the block
+	 * (it will be merged with the head).
+	 */
+	if (end < blk->addr + block_length(tlsf, blk)) {
+		if ((remblk = split_block(tlsf, blk, end - start)) == NULL) {
+			free_block(tlsf, blk);
+			return NULL;
+		}
+		insert_block(tlsf, remblk);
+	}
+	if (block_zero_p(tlsf, blk)) {
+		block_clear_flag(tlsf, blk, TLSF_BLK_ZERO);
+	}
+	return blk;
+}
+#endif
+
+/*
+ * ptr_alloc: allocate and return the pointer to the data (TLSF-INT or
+ * TLSF-HYBRID).
+ */
+void *
+TLSF_CORE(ptr_alloc)(tlsf_t *tlsf, size_t size, unsigned flags)
+{
+	tlsf_blk_t *blk;
+	void *ptr;
+
+	ASSERT(tlsf->mode != TLSF_EXT);
+	blk = TLSF_CORE(alloc)(tlsf, size, flags);
+	if (blk == NULL) {
+		return NULL;
+	}
+#if TLSF_CORE_INT
+	ptr = (uint8_t *)blk + HDR_LEN;
+	ASSERT(((uintptr_t)ptr & (sizeof(unsigned long) - 1)) == 0);
+#else
+	/* TLSF-HYBRID: the header is out of band. */
+	ptr = (void *)blk->addr;
+#endif
+	if (flags & TLSF_ALLOC_ZERO) {
+		block_zero_fill(tlsf, blk, ptr, size);
+	}
+	return ptr;
+}
+
+#if TLSF_CORE_INT
+/*
+ * split: complete the allocation of the block taken off the list by the
+ * inline fast path (see tlsf_inline.h) and return the pointer to data.
+ */
+void *
+TLSF_CORE(split)(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+{
+	blk = alloc_split(tlsf, blk, size, 0);
+	if (block_zero_p(tlsf, blk)) {
+		block_clear_flag(tlsf, blk, TLSF_BLK_ZERO);
+	}
+	return (uint8_t *)blk + HDR_LEN;
+}
+#endif
+
+void
+TLSF_CORE(free)(tlsf_t *tlsf, tlsf_blk_t *blk)
+{
+	ASSERT(block_used_p(tlsf, blk)); /* use-after-free guard */
+
+	if (tlsf->qlimit && quick_insert(tlsf, blk)) {
+		return;
+	}
+	free_block(tlsf, blk);
+}
+
+void
+TLSF_CORE(ptr_free)(tlsf_t *tlsf, void *ptr)
+{
+	tlsf_blk_t *blk;
+
+	ASSERT(tlsf->mode != TLSF_EXT);
+#if TLSF_CORE_INT
+	blk = (tlsf_blk_t *)(void *)((uint8_t *)ptr - HDR_LEN);
+#else
+	/*
+	 * TLSF-HYBRID: look up the header.  The index granularity
+	 * is MBS, so the block starting at the address is the entry.
+	 */
+	blk = addrmap_get(tlsf->addridx, blkidx_key(tlsf, (uintptr_t)ptr));
+	ASSERT(blk != NULL && blk->addr == (uintptr_t)ptr);
+#endif
+	TLSF_CORE(free)(tlsf, blk);
+}
+
+void *
+TLSF_CORE(ptr_lookup)(tlsf_t *tlsf, const void *ptr)
+{
+	const uintptr_t addr = (uintptr_t)ptr;
+	tlsf_blk_t *blk;
+#if TLSF_CORE_INT
+	uint8_t *data;
+#endif
+
+	ASSERT(tlsf->mode != TLSF_EXT);
+	blk = find_block(tlsf, addr);
+	if (!blk || !block_used_p(tlsf, blk)) {
+		return NULL;
+	}
+#if !TLSF_CORE_INT
+	return (void *)blk->addr;
+#else
+	data = (uint8_t *)blk + HDR_LEN;
+	if (block_flag_p(tlsf, blk, TLSF_BLK_MOVABLE)) {
+		/* Skip the handle (see tlsf_handle_alloc). */
+		data += sizeof(uintptr_t);
+	}
+	if (addr < (uintptr_t)data) {
+		/* Points to the block header. */
+		return NULL;
+	}
+	return data;
+#endif
+}
+
+#if TLSF_CORE_INT
+static int
+handle_table_grow(tlsf_t *tlsf)
+{
+	const unsigned hsize = tlsf->hsize;
+	const unsigned nsize = hsize ? hsize * 2 : TLSF_HTAB_INIT;
+	void **htab;
+
+	if (nsize < hsize) {
+		return -1;
+	}
+	if ((htab = realloc(tlsf->htab, nsize * sizeof(void *))) == NULL) {
+		return -1;
+	}
+
+	/* Chain the new entries in front of the free list. */
+	for (unsigned i = hsize; i < nsize; i++) {
+		htab[i] = HTAB_FREE_ENT(i + 1 < nsize ? i + 2 : tlsf->hfree);
+	}
+	tlsf->hfree = hsize + 1;
+	tlsf->hsize = nsize;
+	tlsf->htab = htab;
+	return 0;
+}
+
+tlsf_handle_t
+TLSF_CORE(handle_alloc)(tlsf_t *tlsf, size_t size)
+{
+	tlsf_blk_t *blk;
+	uintptr_t *hp;
+	unsigned h;
+
+	if (tlsf->hfree == 0 && handle_table_grow(tlsf) == -1) {
+		return 0;
+	}
+	if ((blk = TLSF_CORE(alloc)(tlsf, size + sizeof(uintptr_t), 0)) == NULL) {
+		return 0;
+	}
+	block_set_flag(tlsf, blk, TLSF_BLK_MOVABLE);
+
+	/* Take a free entry and point it to the data. */
+	h = tlsf->hfree;
+	ASSERT(HTAB_FREE_P(tlsf->htab[h - 1]));
+	tlsf->hfree = HTAB_FREE_NEXT(tlsf->htab[h - 1]);
+
+	hp = (void *)((uint8_t *)blk + HDR_LEN);
+	*hp = h;
+	tlsf->htab[h - 1] = hp + 1;
+	return h;
+}
+
+void
+TLSF_CORE(handle_free)(tlsf_t *tlsf, tlsf_handle_t h)
+{
+	uint8_t *ptr = tlsf_handle_ptr(tlsf, h);
+	tlsf_blk_t *blk;
+
+	blk = (void *)(ptr - sizeof(uintptr_t) - HDR_LEN);
+	ASSERT(block_flag_p(tlsf, blk, TLSF_BLK_MOVABLE));
+	ASSERT(*(uintptr_t *)(ptr - sizeof(uintptr_t)) == h);
+	block_clear_flag(tlsf, blk, TLSF_BLK_MOVABLE);
+	TLSF_CORE(free)(tlsf, blk);
+
+	tlsf->htab[h - 1] = HTAB_FREE_ENT(tlsf->hfree);
+	tlsf->hfree = h;
+}
+
+/*
+ * move_block: relocate the allocated (relocatable) block into the free
+ * block which physically precedes it.  The free space ends up after the
+ * moved block and it is merged with the next block, if that is free.
+ * Returns the resulting free block or NULL on failure.
+ */
+static tlsf_blk_t *
+move_block(tlsf_t *tlsf, tlsf_blk_t *fblk, tlsf_blk_t *blk)
+{
+	const size_t flen = block_length(tlsf, fblk), blen = block_length(tlsf, blk);
+	tlsf_blk_t *nextblk = get_next_physblk(tlsf, blk);
+	tlsf_blk_t *newfblk;
+	unsigned fli, sli;
+	uintptr_t *hp;
+
+	ASSERT(block_free_p(tlsf, fblk));
+	ASSERT(block_flag_p(tlsf, blk, TLSF_BLK_MOVABLE));
+
+	newfblk = (void *)((uint8_t *)fblk + HDR_LEN + blen);
+	if (tlsf->addridx && blkidx_move(tlsf, blk, newfblk) == -1) {
+		return NULL;
+	}
+	tlsf_get_mapping(tlsf, flen, &fli, &sli);
+	(void)remove_block(tlsf, fblk, fli, sli);
+
+	/*
+	 * Move the data (including the handle) and set up the headers:
+	 * the free block header takes the place of the moved block header
+	 * in the chain.  Note: the regions may overlap.
+	 */
+	hp = (void *)((uint8_t *)fblk + HDR_LEN);
+	memmove(hp, (uint8_t *)blk + HDR_LEN, blen);
+	block_set_lenflags(tlsf, fblk, blen | TLSF_BLK_MOVABLE);
+
+	block_set_lenflags(tlsf, newfblk, flen);
+	set_prev_physblk(newfblk, fblk);
+	if (nextblk) {
+		set_prev_physblk(nextblk, newfblk);
+	}
+
+	/* Update the handle to point to the new location. */
+	ASSERT(*hp > 0 && *hp <= tlsf->hsize);
+	tlsf->htab[*hp - 1] = hp + 1;
+
+	if (nextblk && block_free_p(tlsf, nextblk)) {
+		newfblk = merge_blocks(tlsf, newfblk, nextblk);
+	}
+	insert_block(tlsf, newfblk);
+	return newfblk;
+}
+
+/*
+ * compact: a step of the incremental compaction, see tlsf_compact().
+ */
+int
+TLSF_CORE(compact)(tlsf_t *tlsf, size_t budget)
+{
+	unsigned nscan = TLSF_COMPACT_SCAN;
+	tlsf_blk_t *blk;
+	size_t moved = 0;
+
+	blk = tlsf->compact_cur ? tlsf->compact_cur : (void *)tlsf->baseptr;
+	while (nscan--) {
+		tlsf_blk_t *nextblk, *fblk;
+		size_t nlen;
+
+		if ((nextblk = get_next_physblk(tlsf, blk)) == NULL) {
+			/* Reached the end: the pass is complete. */
+			tlsf->compact_cur = NULL;
+			return 0;
+		}
+
+		/*
+		 * Look for a free block followed by a relocatable block,
+		 * which is small enough to move within the budget.  The
+		 * deferred block is coalesced first: it may get merged
+		 * into its predecessor, so take the block again (there
+		 * always is one, as the relocatable block is not merged).
+		 */
+		if (block_flag_p(tlsf, nextblk, TLSF_BLK_MOVABLE) &&
+		    quick_flush(tlsf, blk) &&
+		    (fblk = get_prev_physblk(tlsf, nextblk)) != NULL) {
+			blk = fblk;
+		}
+		if (block_used_p(tlsf, blk) ||
+		    !block_flag_p(tlsf, nextblk, TLSF_BLK_MOVABLE)) {
+			blk = nextblk;
+			continue;
+		}
+		if ((nlen = block_length(tlsf, nextblk)) > budget) {
+			blk = nextblk;
+			continue;
+		}
+		if (moved + nlen > budget) {
+			break;
+		}
+		if ((fblk = move_block(tlsf, blk, nextblk)) == NULL) {
+			blk = nextblk;
+			continue;
+		}
+		moved += nlen;
+		blk = fblk;
+	}
+	tlsf->compact_cur = blk;
+	return 1;
+}
+#endif
+
+/*
+ * trim: shrink the allocated block in place, see tlsf_ext_trim().
+ */
+int
+TLSF_CORE(trim)(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+{
+	const unsigned mbs = tlsf->mbs;
+	tlsf_blk_t *remblk;
+
+	ASSERT(!block_free_p(tlsf, blk));
+
+	size = size ? roundup2(size, mbs) : mbs;
+	if (size > block_length(tlsf, blk)) {
+		return -1;
+	}
+
+	/*
+	 * Nothing to do if the tail is too small to form a block.
+	 * Otherwise, split it off and free it, so it would be merged
+	 * with the next block if that one is free.
+	 */
+	if ((block_length(tlsf, blk) - size) < (mbs + HDR_LEN)) {
+		return 0;
+	}
+	if ((remblk = split_block(tlsf, blk, size)) == NULL) {
+		return -1;
+	}
+	free_block(tlsf, remblk);
+	return 0;
+}
+
+/*
+ * extend: grow the allocated block in place, see tlsf_ext_extend().
+ */
+int
+TLSF_CORE(extend)(tlsf_t *tlsf, tlsf_blk_t *blk, size_t size)
+{
+	const unsigned mbs = tlsf->mbs;
+	tlsf_blk_t *nextblk;
+
+	ASSERT(!block_free_p(tlsf, blk));
+
+	size = size ? roundup2(size, mbs) : mbs;
+	if (size <= block_length(tlsf, blk)) {
+		return 0;
+	}
+
+	/*
+	 * The next block must be free and the merged space must fit
+	 * the requested size.  If its coalescing was deferred, then
+	 * coalesce it first (it cannot merge into this block).
+	 */
+	nextblk = get_next_physblk(tlsf, blk);
+	if (nextblk && quick_flush(tlsf, nextblk)) {
+		nextblk = get_next_physblk(tlsf, blk);
+	}
+	if (!nextblk || block_used_p(tlsf, nextblk)) {
+		return -1;
+	}
+	if ((block_length(tlsf, blk) + HDR_LEN +
+	    block_length(tlsf, nextblk)) < size) {
+		return -1;
+	}
+	blk = merge_blocks(tlsf, blk, nextblk);
+
+	/*
+	 * Give back the excess, if it is large enough to form a block.
+	 */
+	if ((block_length(tlsf, blk) - size) >= (mbs + HDR_LEN)) {
+		tlsf_blk_t *remblk;
+
+		remblk = split_block(tlsf, blk, size);
+		if (remblk) {
+			insert_block(tlsf, remblk);
+		}
+	}
+	return 0;
+}
+
+#if !TLSF_CORE_INT
+/*
+ * lookup: return the allocated block containing the given address.
+ */
+tlsf_blk_t *
+TLSF_CORE(lookup)(tlsf_t *tlsf, uintptr_t addr)
+{
+	tlsf_blk_t *blk;
+
+	blk = find_block(tlsf, addr);
+	return (blk && block_used_p(tlsf, blk)) ? blk : NULL;
+}
+
+/*
+ * relocate_extblk: move the allocated block to a new location, if there
+ * is a free block (other than its physical neighbours) to accommodate
+ * it, and call the given function to move the data.  On success, the
+ * block header gets the new address and the old space is released, so
+ * it is merged with the free neighbours.
+ *
+ * => Returns 0 on success, -1 if the move function failed and 1 if
+ *    there is no space to relocate the block.
+ */
+static int
+relocate_extblk(tlsf_t *tlsf, tlsf_blk_t *blk, tlsf_move_func_t move,
+    void *arg)
+{
+	tlsf_extblk_t *extblk = (void *)blk, *newextblk, *prev, *newprev;
+	tlsf_blk_t *nbrs[2], *newblk;
+	unsigned fli, sli;
+	uintptr_t addr;
+	size_t len;
+
+	/*
+	 * Temporarily take the free neighbours out of the lists, so the
+	 * new location would be elsewhere.
+	 */
+	nbrs[0] = get_prev_physblk(tlsf, blk);
+	nbrs[1] = get_next_physblk(tlsf, blk);
+	for (unsigned i = 0; i < 2; i++) {
+		if (!nbrs[i] || !block_free_p(tlsf, nbrs[i])) {
+			nbrs[i] = NULL;
+			continue;
+		}
+		tlsf_get_mapping(tlsf, block_length(tlsf, nbrs[i]), &fli, &sli);
+		(void)remove_block(tlsf, nbrs[i], fli, sli);
+	}
+	newblk = TLSF_CORE(alloc)(tlsf, block_length(tlsf, blk), 0);
+	for (unsigned i = 0; i < 2; i++) {
+		if (nbrs[i])
+			insert_block(tlsf, nbrs[i]);
+	}
+	if (newblk == NULL) {
+		return 1;
+	}
+
+	if (move(arg, blk->addr, newblk->addr, block_length(tlsf, blk)) == -1) {
+		free_block(tlsf, newblk);
+		return -1;
+	}
+
+	/*
+	 * Swap the blocks: their address, length and the position in the
+	 * physical chain.  Note: they are not adjacent.
+	 */
+	newextblk = (void *)newblk;
+	prev = TAILQ_PREV(extblk, tlsf_extblk_qh, entry);
+	newprev = TAILQ_PREV(newextblk, tlsf_extblk_qh, entry);
+	ASSERT(prev != newextblk && newprev != extblk);
+
+	TAILQ_REMOVE(&tlsf->blklist, extblk, entry);
+	TAILQ_REMOVE(&tlsf->blklist, newextblk, entry);
+	if (prev) {
+		TAILQ_INSERT_AFTER(&tlsf->blklist, prev, newextblk, entry);
+	} else {
+		TAILQ_INSERT_HEAD(&tlsf->blklist, newextblk, entry);
+	}
+	if (newprev) {
+		TAILQ_INSERT_AFTER(&tlsf->blklist, newprev, extblk, entry);
+	} else {
+		TAILQ_INSERT_HEAD(&tlsf->blklist, extblk, entry);
+	}
+
+	addr = blk->addr, len = blk->len;
+	blk->addr = newblk->addr, blk->len = newblk->len;
+	newblk->addr = addr, newblk->len = len;
+
+	if (tlsf->addridx) {
+		/* The slots exist: the replacements cannot fail. */
+		(void)addrmap_set(tlsf->addridx,
+		    blkidx_key(tlsf, blk->addr), blk);
+		(void)addrmap_set(tlsf->addridx,
+		    blkidx_key(tlsf, newblk->addr), newblk);
+	}
+
+	/*
+	 * Finally, release the old space.  Note: bypass the quick lists,
+	 * the point is to merge it with the free neighbours.
+	 */
+	free_block(tlsf, newblk);
+	return 0;
+}
+
+/*
+ * defrag: a step of the incremental defragmentation, see tlsf_ext_defrag().
+ */
+int
+TLSF_CORE(defrag)(tlsf_t *tlsf, size_t budget, tlsf_move_func_t move,
+    void *arg)
+{
+	unsigned nscan = TLSF_COMPACT_SCAN;
+	tlsf_blk_t *blk, *target = NULL;
+	size_t maxgain = 0;
+
+	/*
+	 * Coalesce the deferred blocks first: otherwise, they are neither
+	 * free neighbours of the candidates, nor merged once released.
+	 */
+	quick_coalesce(tlsf, -1, UINT_MAX);
+
+	/*
+	 * Scan the blocks and pick the target.
+	 */
+	blk = tlsf->compact_cur ? tlsf->compact_cur :
+	    (void *)TAILQ_FIRST(&tlsf->blklist);
+	while (blk && nscan--) {
+		tlsf_blk_t *prevblk, *nextblk;
+		size_t gain = 0;
+
+		nextblk = get_next_physblk(tlsf, blk);
+		if (!block_used_p(tlsf, blk) || block_length(tlsf, blk) > budget) {
+			blk = nextblk;
+			continue;
+		}
+		prevblk = get_prev_physblk(tlsf, blk);
+		if (prevblk && block_free_p(tlsf, prevblk)) {
+			gain += block_length(tlsf, prevblk);
+		}
+		if (nextblk && block_free_p(tlsf, nextblk)) {
+			gain += block_length(tlsf, nextblk);
+		}
+		if (gain > maxgain) {
+			maxgain = gain;
+			target = blk;
+		}
+		blk = nextblk;
+	}
+
+	/*
+	 * Save the position for the next step (note: the cursor is never
+	 * the target) and relocate the target.
+	 */
+	tlsf->compact_cur = blk;
+	if (target && relocate_extblk(tlsf, target, move, arg) == -1) {
+		return -1;
+	}
+	return tlsf->compact_cur != NULL;
+}
+#endif
+
+/*
+ * set_density: set the number of subdivisions of each first-level class,
+ * given as exponents of 2, lay out the rows of the map and re-insert the
+ * free blocks according to the new mapping.  The map is grown, if the
+ * rows do not fit.  Returns -1 if they exceed the maximum map size or on
+ * failure to allocate.
+ */
+int
+TLSF_CORE(set_density)(tlsf_t *tlsf, const uint8_t *density)
+{
+	const unsigned fli_min = ilog2(tlsf->mbs);
+	const unsigned fli_end = fli_min + tlsf->nclasses;
+	tlsf_blk_t *chain = NULL, *blk, **map = NULL;
+	unsigned off = 0;
+
+	for (unsigned fli = fli_min; fli < fli_end; fli++) {
+		ASSERT(density[fli] <= TLSF_DENSITY_MAX);
+		if (class_used_p(tlsf->mbs, tlsf->size, fli))
+			off += 1U << MIN(fli, density[fli]);
+	}
+	if (off > TLSF_MAP_SLOTS) {
+		return -1;
+	}
+	if (off > tlsf->nslots &&
+	    (map = calloc(off, sizeof(tlsf_blk_t *))) == NULL) {
+		return -1;
+	}
+
+	/*
+	 * Take all free blocks off the lists.
+	 */
+	while (tlsf->l1_free) {
+		const unsigned fli = ffsl(tlsf->l1_free) - 1;
+		const unsigned sli =
+		    ffs64(tlsf_fl_class(tlsf, fli)->l2_free) - 1;
+
+		blk = remove_block(tlsf, NULL, fli, sli);
+		blk->next = chain;
+		chain = blk;
+	}
+	if (map) {
+		free(tlsf->map);
+		tlsf->map = map;
+		tlsf->nslots = off;
+	}
+
+	/*
+	 * Lay out the rows: the first-level classes smaller than the
+	 * number of subdivisions get the 1-byte second-level classes.
+	 * The classes which cannot have blocks do not take the map.
+	 */
+	off = 0;
+	for (unsigned fli = fli_min; fli < fli_end; fli++) {
+		tlsf_class_t *fc = tlsf_fl_class(tlsf, fli);
+		const unsigned n = MIN(fli, density[fli]);
+
+		fc->shift = fli - n;
+		fc->row = NULL;
+		if (class_used_p(tlsf->mbs, tlsf->size, fli)) {
+			fc->row = &tlsf->map[off];
+			off += 1U << n;
+		}
+	}
+
+	/* Re-insert the free blocks. */
+	while ((blk = chain) != NULL) {
+		chain = blk->next;
+		insert_block(tlsf, blk);
+	}
+	return 0;
+}
+
+/*
+ * avail_space: return the length of the largest allocatable block,
+ * see tlsf_avail_space().
+ */
+size_t
+TLSF_CORE(avail_space)(tlsf_t *tlsf)
+{
+	const unsigned mbs = tlsf->mbs;
+	unsigned fli, sli;
+	tlsf_blk_t *blk;
+	size_t len, vlen;
+
+	/*
+	 * The designated victim, if any, is allocatable as a whole.
+	 * Find the last block: look at the highest free FLI and SLI
+	 */
+	vlen = tlsf->victim ? block_length(tlsf, tlsf->victim) : 0;
+	if ((fli = flsl(tlsf->l1_free)) == 0) {
+		return vlen;
+	}
+	if ((sli = fls64(tlsf_fl_class(tlsf, --fli)->l2_free)) == 0) {
+		return vlen;
+	}
+	blk = *map_slot(tlsf, fli, --sli);
+	ASSERT(blk);
+
+	/*
+	 * Get its length.
+	 */
+	ASSERT(validate_blkhdr(tlsf, blk));
+	len = block_length(tlsf, blk);
+	ASSERT(tlsf_unused_space(tlsf) >= len);
+
+	/*
+	 * Get the previous size class: we want to return the real
+	 * available size on which tls_alloc() would succeed.
+	 */
+	len = roundup2(len + 1, mbs) - mbs;
+	len = (len + 1) - (1UL << tlsf_class_shift(tlsf, ilog2(len)));
+	return MAX(len, vlen);
+}
+
+
+/*
+ * sync_opts: bring the state in line with the options, once they were
+ * changed, i.e. release the deferred blocks and the victim, if their
+ * use got disabled.
+ */
+void
+TLSF_CORE(sync_opts)(tlsf_t *tlsf)
+{
+	if (tlsf->qlimit == 0) {
+		quick_coalesce(tlsf, -1, UINT_MAX);
+	}
+	if (!tlsf->usevictim && tlsf->victim) {
+		insert_block(tlsf, take_victim(tlsf));
+	}
+}
+
+/*
+ * init: initialise and insert the first block, spanning the whole space.
+ * Returns 0 on success and -1 on failure.
+ */
+int
+TLSF_CORE(init)(tlsf_t *tlsf, bool zeroed)
+{
+	tlsf_blk_t *blk;
+#if !TLSF_CORE_INT
+	tlsf_extblk_t *extblk;
+#endif
+
+#if TLSF_CORE_INT
+	blk = (void *)tlsf->baseptr;
+	block_set_lenflags(tlsf, blk, tlsf->size - HDR_LEN);
+	set_prev_physblk(blk, NULL);
+#else
+	extblk = calloc(1, sizeof(tlsf_extblk_t));
+	if (extblk == NULL) {
+		return -1;
+	}
+	blk = &extblk->hdr;
+	blk->addr = tlsf->baseptr;
+	blk->len = tlsf->size;
+	TAILQ_INSERT_HEAD(&tlsf->blklist, extblk, entry);
+#endif
+	if (tlsf->addridx && addrmap_set(tlsf->addridx, 0, blk) == -1) {
+		return -1;
+	}
+	if (zeroed && ZERO_P) {
+		block_set_flag(tlsf, blk, TLSF_BLK_ZERO);
+	}
+	insert_block(tlsf, blk);
+	return 0;
+}
+
+/*
+ * reset: release all blocks, i.e. make the whole space a single free
+ * block, as it was initialised.  The external headers and the index
+ * nodes are kept for the first block, so it cannot fail.
+ */
+void
+TLSF_CORE(reset)(tlsf_t *tlsf)
+{
+	tlsf_blk_t *blk;
+#if !TLSF_CORE_INT
+	tlsf_extblk_t *extblk, *next;
+#endif
+
+	memset(tlsf->map, 0, tlsf->nslots * sizeof(tlsf_blk_t *));
+	for (unsigned i = 0; i < tlsf->nclasses; i++) {
+		tlsf->classes[i].l2_free = 0;
+	}
+	tlsf->l1_free = 0;
+	tlsf->free = 0;
+	tlsf->victim = NULL;
+	tlsf->compact_cur = NULL;
+
+	if (tlsf->quick) {
+		memset(tlsf->quick, 0, TLSF_QUICK_NUM * sizeof(tlsf_qlist_t));
+	}
+	tlsf->quick_map = 0;
+
+#if TLSF_CORE_INT
+	blk = (void *)tlsf->baseptr;
+	block_set_lenflags(tlsf, blk, tlsf->size - HDR_LEN);
+	set_prev_physblk(blk, NULL);
+#else
+	extblk = TAILQ_FIRST(&tlsf->blklist);
+	while ((next = TAILQ_NEXT(extblk, entry)) != NULL) {
+		TAILQ_REMOVE(&tlsf->blklist, next, entry);
+		free(next);
+	}
+	blk = &extblk->hdr;
+	blk->addr = tlsf->baseptr;
+	blk->len = tlsf->size;
+#endif
+	if (tlsf->addridx) {
+		/* The path of the zero key exists: it cannot fail. */
+		(void)addrmap_clear(tlsf->addridx, blk);
+	}
+	insert_block(tlsf, blk);
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: the core instance for TLSF-EXT and TLSF-HYBRID, i.e. the
+ * external block headers.
+ */
+
+#define	TLSF_CORE_INT		0
+#define	TLSF_CORE_HDRLEN	0
+#define	TLSF_CORE(name)		core_ext_##name
+
+#include "tlsf_core.c"
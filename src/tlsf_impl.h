@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: private definitions, shared by the interface (tlsf.c) and the
+ * core of the allocator (tlsf_core.c).
+ */
+
+#ifndef _TLSF_IMPL_H_
+#define _TLSF_IMPL_H_
+
+#include <sys/queue.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include "tlsf.h"
+#include "tlsf_layout.h"
+#include "addrmap.h"
+#include "utils.h"
+
+/*
+ * The internal allocation flag of tlsf_calloc(): zero-fill the data.
+ */
+#define	TLSF_ALLOC_ZERO		0x100
+
+/*
+ * Handle table entries: a pointer to the data or, if the entry is free,
+ * the index of the next free entry (plus one) with the lowest bit set.
+ */
+#define	HTAB_FREE_P(e)		(((uintptr_t)(e) & 1) != 0)
+#define	HTAB_FREE_ENT(n)	((void *)(((uintptr_t)(n) << 1) | 1))
+#define	HTAB_FREE_NEXT(e)	((unsigned)((uintptr_t)(e) >> 1))
+
+static inline tlsf_blk_t **
+map_slot(tlsf_t *tlsf, unsigned fli, unsigned sli)
+{
+	return &tlsf_fl_class(tlsf, fli)->row[sli];
+}
+
+/*
+ * class_used_p: return true if the first-level class can have blocks,
+ * given the MBS and the space size.  Only such classes take the map.
+ */
+static inline bool
+class_used_p(unsigned mbs, size_t size, unsigned fli)
+{
+	return fli >= (unsigned)ilog2(mbs) && fli <= (unsigned)ilog2(size);
+}
+
+/*
+ * The core of the allocator is compiled for each block header layout:
+ * TLSF-INT with the regular headers (int), TLSF-INT with the compact
+ * headers (cint) and TLSF-EXT, including TLSF-HYBRID (ext).  Therefore,
+ * each instance has no branches on the mode and the header length is a
+ * constant.  The interface dispatches to the instance once per call.
+ */
+
+#define	TLSF_CORE_DECLARE(m)						\
+    int		core_##m##_init(tlsf_t *, bool) __dso_hidden;		\
+    int		core_##m##_set_density(tlsf_t *,			\
+		    const uint8_t *) __dso_hidden;			\
+    void	core_##m##_sync_opts(tlsf_t *) __dso_hidden;		\
+    void	core_##m##_reset(tlsf_t *) __dso_hidden;		\
+    tlsf_blk_t *core_##m##_alloc(tlsf_t *, size_t, unsigned) __dso_hidden; \
+    void	core_##m##_free(tlsf_t *, tlsf_blk_t *) __dso_hidden;	\
+    void *	core_##m##_ptr_alloc(tlsf_t *, size_t, unsigned) __dso_hidden; \
+    void	core_##m##_ptr_free(tlsf_t *, void *) __dso_hidden;	\
+    void *	core_##m##_ptr_lookup(tlsf_t *, const void *) __dso_hidden; \
+    int		core_##m##_trim(tlsf_t *, tlsf_blk_t *, size_t) __dso_hidden; \
+    int		core_##m##_extend(tlsf_t *, tlsf_blk_t *, size_t) __dso_hidden; \
+    size_t	core_##m##_avail_space(tlsf_t *) __dso_hidden;
+
+#define	TLSF_CORE_DECLARE_INT(m)					\
+    tlsf_handle_t core_##m##_handle_alloc(tlsf_t *, size_t) __dso_hidden; \
+    void	core_##m##_handle_free(tlsf_t *, tlsf_handle_t) __dso_hidden; \
+    int		core_##m##_compact(tlsf_t *, size_t) __dso_hidden;	\
+    void *	core_##m##_split(tlsf_t *, tlsf_blk_t *, size_t) __dso_hidden;
+
+#define	TLSF_CORE_DECLARE_EXT(m)					\
+    tlsf_blk_t *core_##m##_alloc_at(tlsf_t *, uintptr_t,		\
+		    size_t) __dso_hidden;				\
+    tlsf_blk_t *core_##m##_lookup(tlsf_t *, uintptr_t) __dso_hidden;	\
+    int		core_##m##_defrag(tlsf_t *, size_t, tlsf_move_func_t,	\
+		    void *) __dso_hidden;
+
+TLSF_CORE_DECLARE(int)
+TLSF_CORE_DECLARE_INT(int)
+TLSF_CORE_DECLARE(cint)
+TLSF_CORE_DECLARE_INT(cint)
+TLSF_CORE_DECLARE(ext)
+TLSF_CORE_DECLARE_EXT(ext)
+
+#endif
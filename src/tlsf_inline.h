@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: optional inline fast paths of tlsf_alloc() and tlsf_free().
+ *
+ * The fast path of the allocation is the size rounding, the class lookup
+ * and taking the head of the free list of the target class, if there is
+ * one: any block there fits, since the size is rounded up to the next
+ * class.  It is inlined at the call site, so the size computations are
+ * folded if the size is a constant.  The rest stays out of line: the
+ * split of the remainder, the search of the higher classes and the other
+ * policies (the designated victim, good-fit, deferred coalescing and the
+ * allocation profile), in which case tlsf_alloc() is simply called.
+ *
+ * If the size is a compile time constant, tlsf_alloc_const() resolves
+ * its class at compile time, leaving only a check that the MBS and the
+ * density are the defaults, and takes the block by the class index.
+ *
+ * The allocation from a scoped region, tlsf_region_alloc_inline(), is a
+ * bump of the pointer; the overflow into a new chunk is out of line.
+ *
+ * => TLSF-INT only; the other modes always take the slow path.
+ * => This header is installed, along with the layout of the allocator
+ *    (tlsf_layout.h) which it exposes, therefore it must be used with the
+ *    library built from the same sources.
+ */
+
+#ifndef _TLSF_INLINE_H_
+#define _TLSF_INLINE_H_
+
+#include "tlsf_layout.h"
+
+__BEGIN_DECLS
+
+/*
+ * Internal ABI: the out-of-line part of the inline fast path, i.e. the
+ * split of the block taken off the list.  Not to be called directly.
+ */
+void *	tlsf_inline_split(tlsf_t *, tlsf_blk_t *, size_t);
+
+__END_DECLS
+
+/*
+ * tlsf_alloc_class: allocate the block of the given size (rounded to the
+ * MBS) from the list of the given target class, i.e. the class which the
+ * size rounds up to.  The fast path takes the head of the list, if it is
+ * not empty; otherwise, it falls back to tlsf_alloc().
+ */
+static inline void *
+tlsf_alloc_class(tlsf_t *tlsf, size_t size, unsigned fli, unsigned sli)
+{
+	const unsigned hdrlen = tlsf->blk_hdr_len;
+	const bool compact = TLSF_COMPACT_P(hdrlen);
+	tlsf_blk_t **headp, *blk;
+	tlsf_class_t *fc;
+	size_t lenflags, len;
+
+	if (TLSF_PREDICT_FALSE(hdrlen == 0 || tlsf->victim || tlsf->goodfit ||
+	    tlsf->quick_map || tlsf->profile)) {
+		return tlsf_alloc(tlsf, size);
+	}
+	fc = tlsf_fl_class(tlsf, fli);
+	if ((fc->l2_free & (UINT64_C(1) << sli)) == 0) {
+		return tlsf_alloc(tlsf, size);
+	}
+
+	/*
+	 * Take the head of the list.  Note: the 'prev' of the head is
+	 * the tail.
+	 */
+	headp = &fc->row[sli];
+	blk = *headp;
+	if ((*headp = blk->next) != NULL) {
+		blk->next->prev = blk->prev;
+	} else {
+		fc->l2_free &= ~(UINT64_C(1) << sli);
+		if (fc->l2_free == 0) {
+			tlsf->l1_free &= ~(1UL << fli);
+		}
+	}
+	lenflags = tlsf_blk_lenflags(blk, compact);
+	len = lenflags & ~TLSF_BLK_FLAGS;
+	TLSF_ASSERT((lenflags & TLSF_BLK_FREE) != 0);
+	TLSF_ASSERT(len >= size);
+	tlsf->free -= len;
+
+	/*
+	 * Clear the free flag.  If the block is larger than the threshold,
+	 * then split it: out of line.  The remainder inherits the known-zero
+	 * flag, which is cleared afterwards; otherwise, clear it now.
+	 */
+	if ((len - size) >= (tlsf->mbs + hdrlen)) {
+		tlsf_blk_set_lenflags(blk, lenflags & ~TLSF_BLK_FREE, compact);
+		return tlsf_inline_split(tlsf, blk, size);
+	}
+	tlsf_blk_set_lenflags(blk, lenflags & ~(TLSF_BLK_FREE | TLSF_BLK_ZERO),
+	    compact);
+	return (uint8_t *)blk + hdrlen;
+}
+
+/*
+ * tlsf_alloc_inline: same as tlsf_alloc(), with the fast path inline.
+ */
+static inline void *
+tlsf_alloc_inline(tlsf_t *tlsf, size_t size)
+{
+	unsigned fli, sli;
+	size_t target;
+
+	if (TLSF_PREDICT_FALSE(size == 0 || size > tlsf->size)) {
+		return tlsf_alloc(tlsf, size);
+	}
+
+	/*
+	 * Round up the size to MBS and then the next size class.
+	 */
+	size = TLSF_ROUNDUP2(size, tlsf->mbs);
+	target = size + (1UL << tlsf_class_shift(tlsf, tlsf_ilog2(size))) - 1;
+	tlsf_get_mapping(tlsf, target, &fli, &sli);
+	return tlsf_alloc_class(tlsf, size, fli, sli);
+}
+
+/*
+ * tlsf_alloc_csize: tlsf_alloc_inline() for the size which is a constant.
+ * The class is computed for the default MBS and density, therefore it is
+ * folded at compile time; it is used only if the MBS and the widths of the
+ * second-level classes are the defaults, which is checked at run time.
+ */
+static inline void *
+tlsf_alloc_csize(tlsf_t *tlsf, size_t size)
+{
+	unsigned sfli, sshift, fli, shift, sli;
+	size_t rsize, target;
+
+	if (size == 0 || size > tlsf->size) {
+		return tlsf_alloc(tlsf, size);
+	}
+	rsize = TLSF_ROUNDUP2(size, TLSF_MBS_DEFAULT);
+	sfli = tlsf_ilog2(rsize);
+	sshift = sfli - TLSF_MIN(sfli, TLSF_SLI_SHIFT);
+	target = rsize + (1UL << sshift) - 1;
+	fli = tlsf_ilog2(target);
+	shift = fli - TLSF_MIN(fli, TLSF_SLI_SHIFT);
+	sli = (target ^ (1UL << fli)) >> shift;
+
+	if (tlsf->mbs != TLSF_MBS_DEFAULT ||
+	    tlsf_class_shift(tlsf, sfli) != sshift ||
+	    tlsf_class_shift(tlsf, fli) != shift) {
+		return tlsf_alloc_inline(tlsf, size);
+	}
+	return tlsf_alloc_class(tlsf, rsize, fli, sli);
+}
+
+/*
+ * tlsf_alloc_const: same as tlsf_alloc(), but if the size is a compile
+ * time constant (e.g. sizeof(struct ...)), then its class is resolved at
+ * compile time.
+ */
+#define	tlsf_alloc_const(tlsf, size)				\
+    (__builtin_constant_p(size) ?				\
+    tlsf_alloc_csize((tlsf), (size)) : tlsf_alloc_inline((tlsf), (size)))
+
+/*
+ * tlsf_free_inline: same as tlsf_free(), but the header of the TLSF-INT
+ * block is found inline.  The merging with the neighbours is out of line.
+ */
+static inline void
+tlsf_free_inline(tlsf_t *tlsf, void *ptr)
+{
+	const unsigned hdrlen = tlsf->blk_hdr_len;
+
+	if (TLSF_PREDICT_FALSE(hdrlen == 0)) {
+		tlsf_free(tlsf, ptr);
+		return;
+	}
+	tlsf_ext_free(tlsf, (tlsf_blk_t *)(void *)((uint8_t *)ptr - hdrlen));
+}
+
+/*
+ * tlsf_region_alloc_inline: same as tlsf_region_alloc(), but the bump of
+ * the pointer is inlined.
+ */
+static inline void *
+tlsf_region_alloc_inline(tlsf_region_t *region, size_t size)
+{
+	const size_t len = TLSF_ROUNDUP2(size, TLSF_REGION_ALIGN);
+	const uintptr_t ptr = region->cur;
+
+	if (TLSF_PREDICT_FALSE(size == 0 || size > len ||
+	    len > region->end - ptr)) {
+		return tlsf_region_alloc(region, size);
+	}
+	region->cur = ptr + len;
+	return (void *)ptr;
+}
+
+#endif
@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: the layout of the allocator, i.e. the block headers and the TLSF
+ * object, with the accessors used by the inline fast paths (tlsf_inline.h).
+ *
+ * => This header is installed, therefore it does not use the helpers of
+ *    the library (utils.h), which have generic names: the few it needs
+ *    are defined here with the TLSF/tlsf prefix.
+ * => The layout is not a stable interface: it may change in any release,
+ *    so it must be used with the library built from the same sources.
+ */
+
+#ifndef _TLSF_LAYOUT_H_
+#define _TLSF_LAYOUT_H_
+
+#include <sys/cdefs.h>
+#include <sys/queue.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <limits.h>
+#if defined(DEBUG)
+#include <assert.h>
+#endif
+
+#include "tlsf.h"
+
+#if defined(DEBUG)
+#define	TLSF_ASSERT(x)		assert(x)
+#else
+#define	TLSF_ASSERT(x)
+#endif
+
+#define	TLSF_PREDICT_FALSE(x)	__builtin_expect((x) != 0, 0)
+#define	TLSF_MIN(x, y)		((x) < (y) ? (x) : (y))
+#define	TLSF_ROUNDUP2(x, m)	((((x) - 1) | ((m) - 1)) + 1)
+
+/*
+ * tlsf_ilog2: return log2 of the given non-zero value, rounded down.
+ */
+static inline unsigned
+tlsf_ilog2(unsigned long x)
+{
+	return (unsigned)(CHAR_BIT * sizeof(unsigned long)) - 1 -
+	    (unsigned)__builtin_clzl(x);
+}
+
+/*
+ * The maximum number of L1 items: just use 2^64 on 64-bit architectures.
+ * Otherwise, log2(4 GB) = 32.
+ */
+#define	TLSF_FLI_MAX		(CHAR_BIT * sizeof(unsigned long))
+
+/*
+ * The number of subdivisions (second-level-index), expressed as an
+ * exponent of 2 for bitwise shifting.  2^5 = 32 subdivisions by default.
+ * It is a compile-time parameter, so the arithmetic is specialised for
+ * the value: 3, 4, 5 or 6 (8, 16, 32 or 64 subdivisions respectively).
+ * The SL bitmap is 64-bit, therefore it can accommodate any of them.
+ */
+#ifndef TLSF_SLI_SHIFT
+#define	TLSF_SLI_SHIFT		5
+#endif
+#if TLSF_SLI_SHIFT < 3 || TLSF_SLI_SHIFT > 6
+#error "TLSF_SLI_SHIFT must be in the [3 .. 6] range"
+#endif
+#define	TLSF_SLI_MAX		(1UL << TLSF_SLI_SHIFT)
+
+/*
+ * The number of subdivisions can also be set per first-level class (see
+ * tlsf_setdensity), up to 2^6 = 64, i.e. the width of the SL bitmap.  The
+ * rows of the map are packed, so the total number of the second-level
+ * lists is bounded by the map size, as with the fixed subdivision.
+ *
+ * However, the map is allocated for the first-level classes which can
+ * have blocks, i.e. from the MBS to the space size, rather than for the
+ * whole range; it grows only if the density is increased.  So are the
+ * first-level classes, i.e. their SL bitmaps, rows and widths (see
+ * tlsf_class_t).  Small spaces therefore have a small map, which also
+ * takes fewer cache lines.
+ */
+#define	TLSF_DENSITY_MAX	6
+#define	TLSF_MAP_SLOTS		(TLSF_FLI_MAX * TLSF_SLI_MAX)
+
+/*
+ * Default minimum block size.
+ */
+#define	TLSF_MBS_DEFAULT	32
+
+/*
+ * The number of quick lists for the deferred coalescing: the block of
+ * length in [(n + 1) * MBS, (n + 2) * MBS) range goes to the n-th list.
+ */
+#define	TLSF_QUICK_NUM		32
+
+/*
+ * Each memory block is tracked using a block header.  There are two
+ * cases: TLSF-INT and TLSF-EXT i.e. internalised or externalised block
+ * header use.
+ *
+ * - TLSF-INT case has block header (tlsf_blk_t) prepended at the
+ *   beginning of the allocated space.  Therefore, allocation function
+ *   always increments the requested size by the header length, i.e.
+ *   TLSF_BLKHDR_LEN or TLSF_CBLKHDR_LEN (see below).
+ *
+ * - TLSF-INT: Used (allocated) memory blocks use the whole tlsf_blk_t,
+ *   while free blocks have do not use segregation list entries,
+ *   therefore their effective size is reduced by the header length.
+ *
+ * - TLSF-EXT case has a separate header (tlsf_extblk_t) allocated
+ *   externally for the both cases i.e. allocated and free.  The header
+ *   additionally stores the address (tlsf_blk_t::addr).
+ *
+ * - TLSF-HYBRID is TLSF-EXT internally, but the space is addressable
+ *   and the address is returned as a pointer.  The header is found using
+ *   the address index, which is always maintained in this mode.
+ *
+ * - All block headers are linked in the order of the physical address
+ *   they represent.  TLSF-INT uses 'prevblk' member and is linked only
+ *   backwards (next header can be worked out based on the block length).
+ *   TLSF-EXT uses doubly linked list (tlsf_extblk_t::entry).
+ *
+ * - Free blocks are additionally linked within their size class.
+ *   The list is doubly linked and the 'prev' of the head points to the
+ *   tail, so that the blocks can be appended in O(1) time.
+ *
+ * - The length field stores the block length excluding the header.
+ *   The highest bits of the length are used as flags: the block is free,
+ *   the block is relocatable (TLSF-INT only, see tlsf_handle_alloc) or
+ *   the block is on a quick list, i.e. released but not coalesced yet.
+ *   Note: such block is not marked as free, so it is not merged with the
+ *   neighbours until it is taken off the quick list.
+ *
+ * - The free block may be known to be zero-filled (see TLSF_ZEROED),
+ *   except its segregation list entries with TLSF-INT.  The flag is
+ *   inherited by the remainders of the split and kept by a merge only if
+ *   both blocks have it; the allocated blocks never have it.  It is not
+ *   used with the compact headers, which have no spare bit.
+ *
+ * - TLSF-INT with the compact headers (see TLSF_COMPACT): the header is
+ *   only the first word of tlsf_blk_t, which is used as tlsf_cblk_t, i.e.
+ *   the length and the distance to the previous block as 32-bit fields,
+ *   both in 8-byte units.  The flags are the highest bits of the length,
+ *   as above.  The block lengths are always multiples of 8, since the
+ *   MBS is and the headers are, therefore up to 4 GB can be represented.
+ *   The free block still uses the 'next' and 'prev' of tlsf_blk_t, i.e.
+ *   the segregation list entries stay at the same offset as with the full
+ *   header (two words from the start), leaving the word after the compact
+ *   header unused.  Hence the data of the free block must fit those, which
+ *   the MBS guarantees.
+ */
+
+#define	TLSF_BLK_FREE		(~(SIZE_MAX >> 1))
+#define	TLSF_BLK_MOVABLE	(TLSF_BLK_FREE >> 1)
+#define	TLSF_BLK_QUICK		(TLSF_BLK_FREE >> 2)
+#define	TLSF_BLK_ZERO		(TLSF_BLK_FREE >> 3)
+#define	TLSF_BLK_FLAGS		\
+    (TLSF_BLK_FREE | TLSF_BLK_MOVABLE | TLSF_BLK_QUICK | TLSF_BLK_ZERO)
+
+struct tlsf_blk {
+	/*
+	 * Length and:
+	 * - TLSF-EXT: real address
+	 * - TLSF-INT: previous block
+	 */
+	size_t			len;
+	union {
+		uintptr_t	addr;
+		struct tlsf_blk *prevblk;
+	};
+
+	/* Segregation list entries. */
+	struct tlsf_blk *	next;
+	struct tlsf_blk *	prev;
+};
+
+#define	TLSF_BLKHDR_LEN		(offsetof(tlsf_blk_t, next))
+
+typedef struct {
+	uint32_t		len;
+	uint32_t		prev;
+} tlsf_cblk_t;
+
+#define	TLSF_CBLKHDR_LEN	(sizeof(tlsf_cblk_t))
+#define	TLSF_CBLK_SHIFT		3
+#define	TLSF_CBLK_FLAGS		(UINT32_C(7) << 29)
+#define	TLSF_CBLK_MAXSIZE	(UINT32_MAX)
+
+typedef struct tlsf_extblk {
+	/*
+	 * The main header and the physical block chain.
+	 */
+	tlsf_blk_t		hdr;
+	TAILQ_ENTRY(tlsf_extblk) entry;
+} tlsf_extblk_t;
+
+/*
+ * First-level class: the SL bitmap, the row of its second-level lists in
+ * the map and the width of its second-level classes (as an exponent of 2).
+ * The classes are allocated only for the range the space can use.
+ */
+typedef struct {
+	uint64_t		l2_free;
+	tlsf_blk_t **		row;
+	unsigned		shift;
+} tlsf_class_t;
+
+/*
+ * Quick list of the deferred blocks (see TLSF_OPT_DEFER).
+ */
+typedef struct {
+	tlsf_blk_t *		head;
+	unsigned		count;
+} tlsf_qlist_t;
+
+struct tlsf {
+	/*
+	 * The hot fields, used by every allocation and free, are kept
+	 * together at the beginning, i.e. in the first cache line.
+	 *
+	 * - Prepended the block header length (TLSF-INT only).
+	 *   If zero, TLSF-EXT is being used.  If TLSF_CBLKHDR_LEN,
+	 *   the compact headers are used.
+	 */
+	unsigned long		l1_free;
+	tlsf_class_t *		classes;
+	size_t			free;
+	tlsf_blk_t *		victim;
+	unsigned long		quick_map;
+	size_t *		profile;
+	unsigned		mbs;
+	unsigned		blk_hdr_len;
+	unsigned		qlimit;
+	unsigned		goodfit;
+
+	/*
+	 * The segregation map (see above) and the first-level classes,
+	 * from the MBS class up to the class above the space size, since
+	 * the rounded up size may fall into it.  The map is sized for the
+	 * classes which can have blocks.
+	 */
+	tlsf_blk_t **		map;
+	unsigned		nslots;
+	unsigned		nclasses;
+
+	/* Base pointer, size of the whole space and the mode. */
+	uintptr_t		baseptr;
+	size_t			size;
+	tlsf_mode_t		mode;
+	TAILQ_HEAD(tlsf_extblk_qh, tlsf_extblk) blklist;
+
+	/*
+	 * Optional address index of the blocks (see TLSF_ADDRIDX).
+	 * The key is the address offset divided by the granularity and
+	 * it points to the first block starting within that granule.
+	 */
+	struct addrmap *	addridx;
+	unsigned		idx_shift;
+
+	/*
+	 * Handle table of the relocatable blocks: the entries point to
+	 * the data or, if free, store the next free entry.  Compaction
+	 * (or defragmentation) cursor: the block from which the next step
+	 * continues.
+	 */
+	void **			htab;
+	unsigned		hsize;
+	unsigned		hfree;
+	tlsf_blk_t *		compact_cur;
+
+	/*
+	 * Allocation policy options (see tlsf_setopt), including:
+	 *
+	 * - Good-fit scan limit (see above).
+	 * - Designated victim (see TLSF_OPT_VICTIM): the last split
+	 *   remainder, kept free but outside the segregated lists.
+	 * - Allocation profile: the number of allocations per first-level
+	 *   class, if collecting (see TLSF_OPT_PROFILE).
+	 */
+	tlsf_order_t		order;
+	size_t			topdown;
+	bool			usevictim;
+
+	/*
+	 * Deferred coalescing (see TLSF_OPT_DEFER): the quick lists of
+	 * the free blocks which are not merged yet, allocated once the
+	 * option is enabled, and the maximum number of blocks to coalesce
+	 * per call.  The bitmap of the non-empty lists and the list length
+	 * limit are among the hot fields.
+	 */
+	tlsf_qlist_t *		quick;
+	unsigned		qbudget;
+};
+
+
+/*
+ * TLSF_COMPACT_P: true if the given header length means the compact
+ * headers.  Note: never if the regular header is not larger anyway.
+ */
+#define	TLSF_COMPACT_P(hdrlen)	\
+    ((hdrlen) == TLSF_CBLKHDR_LEN && TLSF_BLKHDR_LEN > TLSF_CBLKHDR_LEN)
+
+/*
+ * tlsf_blk_lenflags: return the length of the TLSF-INT block with the flags,
+ * i.e. the 'len' field, decoding the compact header if it is used.
+ */
+static inline size_t
+tlsf_blk_lenflags(const tlsf_blk_t *blk, bool compact)
+{
+	if (compact) {
+		const uint64_t clen = ((const tlsf_cblk_t *)(const void *)blk)->len;
+
+		return (size_t)((clen & TLSF_CBLK_FLAGS) << 32 |
+		    (clen & ~TLSF_CBLK_FLAGS) << TLSF_CBLK_SHIFT);
+	}
+	return blk->len;
+}
+
+static inline void
+tlsf_blk_set_lenflags(tlsf_blk_t *blk, size_t len, bool compact)
+{
+	if (compact) {
+		tlsf_cblk_t *cblk = (tlsf_cblk_t *)(void *)blk;
+		const uint64_t flags = len & TLSF_BLK_FLAGS;
+
+		len &= ~TLSF_BLK_FLAGS;
+		TLSF_ASSERT((len & ((1U << TLSF_CBLK_SHIFT) - 1)) == 0);
+		TLSF_ASSERT((len >> TLSF_CBLK_SHIFT) <= ~TLSF_CBLK_FLAGS);
+		cblk->len = (uint32_t)(flags >> 32) |
+		    (uint32_t)(len >> TLSF_CBLK_SHIFT);
+		return;
+	}
+	blk->len = len;
+}
+
+/*
+ * Scoped region (see tlsf_region.c): the bump pointer and the end of the
+ * current chunk, the chunk size and the list of the overflow chunks.
+ * The descriptor is at the beginning of the first chunk.
+ */
+#define	TLSF_REGION_ALIGN	16
+
+struct tlsf_region {
+	uintptr_t		cur;
+	uintptr_t		end;
+	tlsf_t *		tlsf;
+	size_t			csize;
+	void *			chunks;
+};
+
+/*
+ * tlsf_fl_class: return the first-level class of the given FLI.
+ */
+static inline tlsf_class_t *
+tlsf_fl_class(const tlsf_t *tlsf, unsigned fli)
+{
+	const unsigned idx = fli - tlsf_ilog2(tlsf->mbs);
+
+	TLSF_ASSERT(idx < tlsf->nclasses);
+	return &tlsf->classes[idx];
+}
+
+/*
+ * tlsf_class_shift: return the width of the second-level classes of the given
+ * first-level class, as an exponent of 2.
+ */
+static inline unsigned
+tlsf_class_shift(const tlsf_t *tlsf, unsigned fli)
+{
+	return tlsf_fl_class(tlsf, fli)->shift;
+}
+
+/*
+ * tlsf_get_mapping: given the size return FLI and SLI.
+ */
+static inline void
+tlsf_get_mapping(const tlsf_t *tlsf, size_t size, unsigned *fli, unsigned *sli)
+{
+	/*
+	 * => First-level-index (FLI) = log2(size)
+	 * => Second-level-index (SLI) = (size - 2^f) * (2^SLI / 2^f)
+	 *
+	 * The SLI can be calculated using bitwise operations:
+	 * - We clear 2^FLI bit to get the subsize for SLI.
+	 * - FLI itself is the maximum subsize within the FL class.
+	 *
+	 * Therefore:
+	 *
+	 *	subsize = (size ^ (1U << FLI))
+	 *	SLI = (subsize * TLSF_SLI_MAX) / max_subsize
+	 *	    = (subsize * TLSF_SLI_MAX) / 2^FLI
+	 *	    = (subsize << TLSF_SLI_SHIFT) >> FLI
+	 *	    = subsize >> (FLI - TLSF_SLI)
+	 *
+	 * The number of subdivisions may differ per FL class, therefore
+	 * (FLI - TLSF_SLI) is looked up (see tlsf_class_shift).
+	 */
+	*fli = tlsf_ilog2(size);
+	*sli = (size ^ (1UL << *fli)) >> tlsf_class_shift(tlsf, *fli);
+	TLSF_ASSERT(*fli < TLSF_FLI_MAX);
+	TLSF_ASSERT(*sli < (1UL << TLSF_DENSITY_MAX));
+}
+
+#endif
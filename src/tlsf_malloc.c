@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: malloc(3) interposition library (libtlsf-malloc).
+ *
+ * It implements the standard allocation functions on top of TLSF-INT,
+ * so that the unmodified programs can use it with LD_PRELOAD.
+ *
+ * - The memory is obtained using mmap(2) in chunks.  Each chunk is a TLSF
+ *   space; a chunk descriptor is at its beginning.  The chunks are aligned
+ *   to their size, therefore the descriptor of any allocation is found by
+ *   masking its address.  The fresh chunks are zero-filled, so calloc(3)
+ *   does not zero the memory which was not used yet (see tlsf_calloc).
+ *
+ * - The chunks belong to arenas, each having its own lock.  The threads
+ *   are assigned to the arenas in a round-robin manner.  The memory is
+ *   released to the arena of its chunk, i.e. the frees may be remote.
+ *
+ * - The allocations larger than a quarter of the chunk are mapped
+ *   directly, as separate chunks, and unmapped once freed.
+ *
+ * - The alignments above the natural one take a larger block: the data
+ *   pointer is aligned within it and the word in front of it stores the
+ *   pointer to the block, tagged with the lowest bit.  Otherwise, that
+ *   word is the 'prevblk' of the TLSF-INT block header, i.e. a pointer.
+ *
+ * - TLSF itself uses calloc(3) for the descriptors of the chunks: these
+ *   nested calls are served by a simple bump allocator (and the frees,
+ *   only on the error paths, are ignored).
+ *
+ * - The locks are acquired before fork(2) and reinitialised in the child.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <malloc.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "tlsf_impl.h"
+#include "tlsf_inline.h"
+
+#ifndef TLSF_MALLOC_CHUNK_SHIFT
+#define	TLSF_MALLOC_CHUNK_SHIFT	25	/* 32 MB */
+#endif
+
+#ifndef TLSF_MALLOC_ARENAS
+#define	TLSF_MALLOC_ARENAS	16
+#endif
+
+#define	CHUNK_SIZE		((size_t)1 << TLSF_MALLOC_CHUNK_SHIFT)
+#define	CHUNK_MASK		(CHUNK_SIZE - 1)
+#define	CHUNK_HDR_LEN		roundup2(sizeof(chunk_t), 64)
+#define	CHUNK_LARGE		(CHUNK_SIZE / 4)
+
+/*
+ * The natural alignment: the TLSF-INT data follows the block header and
+ * the block lengths are multiples of the MBS.
+ */
+#define	MALLOC_ALIGN		TLSF_BLKHDR_LEN
+#define	META_SIZE		(64 * 1024)
+
+typedef struct arena arena_t;
+
+typedef struct chunk {
+	arena_t *		arena;
+	tlsf_t *		tlsf;
+	size_t			len;
+	struct chunk *		next;
+} chunk_t;
+
+struct arena {
+	pthread_mutex_t		lock;
+	chunk_t *		chunks;
+} __attribute__((__aligned__(64)));
+
+static arena_t			arenas[TLSF_MALLOC_ARENAS] = {
+	[0 ... TLSF_MALLOC_ARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static unsigned			arena_next;
+
+static pthread_mutex_t		meta_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *		meta_cur;
+static size_t			meta_avail;
+
+#define	TLS_ATTR	__thread __attribute__((__tls_model__("initial-exec")))
+
+static TLS_ATTR arena_t *	thread_arena;
+static TLS_ATTR bool		in_tlsf;
+
+/*
+ * The word in front of the data pointer is the 'prevblk' of the header.
+ */
+_Static_assert(offsetof(tlsf_blk_t, prevblk) + sizeof(void *) ==
+    TLSF_BLKHDR_LEN, "the header must end with prevblk");
+
+static void
+arenas_init(void)
+{
+	for (unsigned i = 0; i < TLSF_MALLOC_ARENAS; i++) {
+		pthread_mutex_init(&arenas[i].lock, NULL);
+	}
+	pthread_mutex_init(&meta_lock, NULL);
+}
+
+static void
+arenas_lock(void)
+{
+	pthread_mutex_lock(&meta_lock);
+	for (unsigned i = 0; i < TLSF_MALLOC_ARENAS; i++) {
+		pthread_mutex_lock(&arenas[i].lock);
+	}
+}
+
+static void
+arenas_unlock(void)
+{
+	for (unsigned i = 0; i < TLSF_MALLOC_ARENAS; i++) {
+		pthread_mutex_unlock(&arenas[i].lock);
+	}
+	pthread_mutex_unlock(&meta_lock);
+}
+
+/*
+ * The arenas are statically initialised, so they are usable before the
+ * constructor runs; it only registers the fork handlers.  The child has
+ * a single thread, therefore it simply reinitialises the locks.
+ */
+static void __attribute__((__constructor__))
+tlsf_malloc_init(void)
+{
+	pthread_atfork(arenas_lock, arenas_unlock, arenas_init);
+}
+
+static inline arena_t *
+get_arena(void)
+{
+	arena_t *arena = thread_arena;
+
+	if (__predict_false(arena == NULL)) {
+		const unsigned i = __atomic_fetch_add(&arena_next, 1,
+		    __ATOMIC_RELAXED);
+		arena = thread_arena = &arenas[i % TLSF_MALLOC_ARENAS];
+	}
+	return arena;
+}
+
+static inline chunk_t *
+ptr_chunk(const void *ptr)
+{
+	return (chunk_t *)((uintptr_t)ptr & ~(uintptr_t)CHUNK_MASK);
+}
+
+/*
+ * meta_alloc: the bump allocation for the nested calls.  The memory is
+ * never reused, therefore it is zeroed.
+ */
+static void *
+meta_alloc(size_t size)
+{
+	void *ptr = NULL;
+
+	size = roundup2(size ? size : 1, MALLOC_ALIGN);
+	pthread_mutex_lock(&meta_lock);
+	if (meta_avail < size) {
+		const size_t len = MAX(size, META_SIZE);
+		void *mem;
+
+		mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANON, -1, 0);
+		if (mem == MAP_FAILED) {
+			goto out;
+		}
+		meta_cur = mem;
+		meta_avail = len;
+	}
+	ptr = meta_cur;
+	meta_cur += size;
+	meta_avail -= size;
+out:
+	pthread_mutex_unlock(&meta_lock);
+	return ptr;
+}
+
+/*
+ * map_chunk: map the memory of the given length, aligned to the chunk
+ * size, and initialise the descriptor at its beginning.
+ */
+static chunk_t *
+map_chunk(size_t len)
+{
+	uintptr_t addr, base;
+	chunk_t *chunk;
+	void *mem;
+
+	if (len > SIZE_MAX - CHUNK_SIZE) {
+		return NULL;
+	}
+	mem = mmap(NULL, len + CHUNK_SIZE, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+	if (mem == MAP_FAILED) {
+		return NULL;
+	}
+
+	/* Trim the unaligned head and the rest of the tail. */
+	addr = (uintptr_t)mem;
+	base = roundup2(addr, CHUNK_SIZE);
+	if (base != addr) {
+		munmap(mem, base - addr);
+	}
+	munmap((void *)(base + len), CHUNK_SIZE - (base - addr));
+
+	chunk = (chunk_t *)base;
+	chunk->len = len;
+	return chunk;
+}
+
+static chunk_t *
+chunk_create(arena_t *arena)
+{
+	chunk_t *chunk;
+
+	if ((chunk = map_chunk(CHUNK_SIZE)) == NULL) {
+		return NULL;
+	}
+	in_tlsf = true;
+	chunk->tlsf = tlsf_create2((uintptr_t)chunk + CHUNK_HDR_LEN,
+	    CHUNK_SIZE - CHUNK_HDR_LEN, 0, TLSF_INT, TLSF_ZEROED);
+	in_tlsf = false;
+
+	if (chunk->tlsf == NULL) {
+		munmap(chunk, CHUNK_SIZE);
+		return NULL;
+	}
+	chunk->arena = arena;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	return chunk;
+}
+
+static void *
+chunk_alloc(chunk_t *chunk, size_t size, size_t align, bool zero)
+{
+	uintptr_t raw, addr;
+
+	if (zero) {
+		ASSERT(align == MALLOC_ALIGN);
+		return tlsf_calloc(chunk->tlsf, 1, size);
+	}
+	if (align <= MALLOC_ALIGN) {
+		return tlsf_alloc_inline(chunk->tlsf, size);
+	}
+	if ((raw = (uintptr_t)tlsf_alloc(chunk->tlsf, size + align)) == 0) {
+		return NULL;
+	}
+	addr = roundup2(raw + 1, align);
+	((uintptr_t *)addr)[-1] = raw | 1;
+	return (void *)addr;
+}
+
+static void *
+large_alloc(size_t size, size_t align)
+{
+	const size_t off = MAX(CHUNK_HDR_LEN, align);
+	const size_t pgsize = (size_t)sysconf(_SC_PAGESIZE);
+	chunk_t *chunk;
+
+	if (size > SIZE_MAX - off - pgsize) {
+		return NULL;
+	}
+	if ((chunk = map_chunk(roundup2(off + size, pgsize))) == NULL) {
+		return NULL;
+	}
+	chunk->arena = NULL;
+	chunk->tlsf = NULL;
+	return (uint8_t *)chunk + off;
+}
+
+/*
+ * arena_malloc: allocate the memory of the given size and alignment and,
+ * if requested, zero it.  Note: the mapped memory is zero-filled.
+ */
+static void *
+arena_malloc(size_t size, size_t align, bool zero)
+{
+	arena_t *arena;
+	chunk_t *chunk;
+	void *ptr = NULL;
+
+	if (__predict_false(in_tlsf)) {
+		return meta_alloc(size);
+	}
+	if (__predict_false(align >= CHUNK_SIZE)) {
+		goto out;
+	}
+	size = size ? size : 1;
+	if (size > CHUNK_LARGE || align > CHUNK_LARGE - size) {
+		ptr = large_alloc(size, align);
+		goto out;
+	}
+
+	/*
+	 * Try the chunks of the arena, the most recent first, and add
+	 * a new chunk if none of them has the space.
+	 */
+	arena = get_arena();
+	pthread_mutex_lock(&arena->lock);
+	for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+		if ((ptr = chunk_alloc(chunk, size, align, zero)) != NULL)
+			break;
+	}
+	if (ptr == NULL && (chunk = chunk_create(arena)) != NULL) {
+		ptr = chunk_alloc(chunk, size, align, zero);
+	}
+	pthread_mutex_unlock(&arena->lock);
+out:
+	if (__predict_false(ptr == NULL)) {
+		errno = ENOMEM;
+	}
+	return ptr;
+}
+
+/*
+ * ptr_block: return the pointer to the TLSF block data.
+ */
+static inline void *
+ptr_block(void *ptr)
+{
+	const uintptr_t word = ((const uintptr_t *)ptr)[-1];
+
+	return (word & 1) ? (void *)(word & ~(uintptr_t)1) : ptr;
+}
+
+void *
+malloc(size_t size)
+{
+	return arena_malloc(size, MALLOC_ALIGN, false);
+}
+
+void
+free(void *ptr)
+{
+	chunk_t *chunk;
+	arena_t *arena;
+
+	if (ptr == NULL || __predict_false(in_tlsf)) {
+		return;
+	}
+	chunk = ptr_chunk(ptr);
+	if ((arena = chunk->arena) == NULL) {
+		munmap(chunk, chunk->len);
+		return;
+	}
+	pthread_mutex_lock(&arena->lock);
+	tlsf_free_inline(chunk->tlsf, ptr_block(ptr));
+	pthread_mutex_unlock(&arena->lock);
+}
+
+size_t
+malloc_usable_size(void *ptr)
+{
+	const tlsf_blk_t *blk;
+	chunk_t *chunk;
+	uint8_t *raw;
+
+	if (ptr == NULL) {
+		return 0;
+	}
+	chunk = ptr_chunk(ptr);
+	if (chunk->arena == NULL) {
+		return chunk->len - ((uintptr_t)ptr - (uintptr_t)chunk);
+	}
+	raw = ptr_block(ptr);
+	blk = (const void *)(raw - TLSF_BLKHDR_LEN);
+	return (tlsf_blk_lenflags(blk, false) & ~TLSF_BLK_FLAGS) -
+	    (size_t)((uint8_t *)ptr - raw);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	if (size && nmemb > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return arena_malloc(nmemb * size, MALLOC_ALIGN, true);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	size_t len;
+	void *nptr;
+
+	if (ptr == NULL) {
+		return malloc(size);
+	}
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
+	/* Keep the block, unless it would waste more than a half. */
+	len = malloc_usable_size(ptr);
+	if (size <= len && size >= len / 2) {
+		return ptr;
+	}
+	if ((nptr = malloc(size)) == NULL) {
+		return NULL;
+	}
+	memcpy(nptr, ptr, MIN(size, len));
+	free(ptr);
+	return nptr;
+}
+
+int
+posix_memalign(void **memptr, size_t align, size_t size)
+{
+	void *ptr;
+
+	if (align < sizeof(void *) || (align & (align - 1)) != 0) {
+		return EINVAL;
+	}
+	if ((ptr = arena_malloc(size, align, false)) == NULL) {
+		return ENOMEM;
+	}
+	*memptr = ptr;
+	return 0;
+}
+
+void *
+aligned_alloc(size_t align, size_t size)
+{
+	if (align == 0 || (align & (align - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return arena_malloc(size, align, false);
+}
+
+/*
+ * The obsolete functions, which must be provided too, as the C library
+ * would otherwise use its own allocator for them.
+ */
+
+void *
+memalign(size_t align, size_t size)
+{
+	return aligned_alloc(align, size);
+}
+
+void *
+valloc(size_t size)
+{
+	return arena_malloc(size, (size_t)sysconf(_SC_PAGESIZE), false);
+}
+
+void *
+pvalloc(size_t size)
+{
+	const size_t pgsize = (size_t)sysconf(_SC_PAGESIZE);
+
+	if (size > SIZE_MAX - pgsize) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return arena_malloc(roundup2(size ? size : 1, pgsize), pgsize, false);
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: scoped regions, i.e. the bump-pointer sub-arenas for the objects
+ * which are released all together (e.g. per request).
+ *
+ * A region takes one large block from the space and serves the
+ * allocations by advancing a pointer within it; the objects are not freed
+ * individually.  Ending the region releases the block with a single
+ * tlsf_free(), so there is no per-object free or merging.
+ *
+ * Once the block (chunk) is exhausted, the region overflows into another
+ * chunk of the same size.  The overflow chunks are linked through their
+ * first word and released when the region ends.  The allocations larger
+ * than a quarter of the chunk get a chunk of their own, so that the rest
+ * of the current chunk is not wasted.
+ *
+ * => Not supported with TLSF-EXT, as the space is not necessarily memory.
+ * => The allocations are aligned to TLSF_REGION_ALIGN.
+ */
+
+#include <stdlib.h>
+
+#include "tlsf_impl.h"
+
+/*
+ * region_chunk: allocate an overflow chunk, which can fit 'len' bytes,
+ * and link it.  Returns the address of the data and sets the end of the
+ * chunk; returns 0 on failure.
+ */
+static uintptr_t
+region_chunk(tlsf_region_t *region, size_t len, uintptr_t *end)
+{
+	const size_t clen = len + 2 * TLSF_REGION_ALIGN;
+	void **chunk;
+
+	if ((chunk = tlsf_alloc(region->tlsf, clen)) == NULL) {
+		return 0;
+	}
+	*chunk = region->chunks;
+	region->chunks = chunk;
+
+	*end = (uintptr_t)chunk + clen;
+	return roundup2((uintptr_t)(chunk + 1), TLSF_REGION_ALIGN);
+}
+
+/*
+ * tlsf_region_begin: create a region, taking the block of the given size
+ * (the chunk size) from the space.  Returns NULL on failure.
+ */
+tlsf_region_t *
+tlsf_region_begin(tlsf_t *tlsf, size_t size)
+{
+	const size_t len = sizeof(tlsf_region_t) + size;
+	tlsf_region_t *region;
+
+	if (tlsf->mode == TLSF_EXT || size == 0 || size > (SIZE_MAX >> 2)) {
+		return NULL;
+	}
+	if ((region = tlsf_alloc(tlsf, len)) == NULL) {
+		return NULL;
+	}
+	region->cur = roundup2((uintptr_t)(region + 1), TLSF_REGION_ALIGN);
+	region->end = (uintptr_t)region + len;
+	region->tlsf = tlsf;
+	region->csize = size;
+	region->chunks = NULL;
+	return region;
+}
+
+/*
+ * tlsf_region_alloc: allocate the memory from the region.  The memory is
+ * valid until the region ends.  Returns NULL on failure.
+ *
+ * => The fast path is a bump of the pointer (see also the inline version,
+ *    tlsf_region_alloc_inline); otherwise, takes an overflow chunk.
+ */
+void *
+tlsf_region_alloc(tlsf_region_t *region, size_t size)
+{
+	const size_t len = roundup2(MAX(size, 1), TLSF_REGION_ALIGN);
+	uintptr_t ptr = region->cur, end;
+
+	if (__predict_true(size <= len && len <= region->end - ptr)) {
+		region->cur = ptr + len;
+		return (void *)ptr;
+	}
+	if (size > len || len > (SIZE_MAX >> 2)) {
+		return NULL;
+	}
+
+	/*
+	 * The large allocation gets its own chunk, keeping the current one.
+	 * Otherwise, take a new chunk; if the space cannot fit a whole
+	 * chunk, try to fit at least this allocation.
+	 */
+	if (len > region->csize / 4) {
+		ptr = region_chunk(region, len, &end);
+		return (void *)ptr;
+	}
+	if ((ptr = region_chunk(region, region->csize, &end)) == 0 &&
+	    (ptr = region_chunk(region, len, &end)) == 0) {
+		return NULL;
+	}
+	region->cur = ptr + len;
+	region->end = end;
+	return (void *)ptr;
+}
+
+/*
+ * tlsf_region_end: release all memory of the region, including the
+ * region itself.
+ */
+void
+tlsf_region_end(tlsf_region_t *region)
+{
+	tlsf_t *tlsf = region->tlsf;
+	void **chunk = region->chunks;
+
+	while (chunk) {
+		void **next = *chunk;
+
+		tlsf_free(tlsf, chunk);
+		chunk = next;
+	}
+	tlsf_free(tlsf, region);
+}
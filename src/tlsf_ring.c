@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2026 Mindaugas Rasiukevicius <rmind at noxt eu>
+ * All rights reserved.
+ *
+ * Use is subject to license terms, as specified in the LICENSE file.
+ */
+
+/*
+ * TLSF: ring buffer allocation, for the records which are allocated in
+ * order and mostly freed in the same order (FIFO), e.g. the log records.
+ *
+ * The ring takes one block from the space.  The allocations advance the
+ * head and the frees advance the tail, so neither is more than a bump of
+ * the pointer; there is no splitting or merging of the blocks.  Each
+ * record is preceded by a word storing its length and the free bit.
+ *
+ * The record freed out of order is only marked free (i.e. the release is
+ * deferred); once the tail reaches it, the tail advances over all the
+ * consecutive free records.  If the record does not fit at the end of
+ * the buffer, the rest is skipped as a free record and the head wraps
+ * around to the beginning.
+ *
+ * If the ring is full, e.g. because a long-lived record holds the tail,
+ * then the allocation falls back to the regular TLSF allocation from the
+ * space; tlsf_ring_free() releases such records using tlsf_free().
+ *
+ * => Not supported with TLSF-EXT, as the space is not necessarily memory.
+ * => The records are aligned to TLSF_RING_ALIGN.
+ */
+
+#include <stdlib.h>
+
+#include "tlsf_impl.h"
+
+#define	TLSF_RING_ALIGN		16
+#define	TLSF_RING_HDR		sizeof(size_t)
+#define	TLSF_RING_FREE		((size_t)1)
+
+struct tlsf_ring {
+	/*
+	 * The head (the next record) and the tail (the oldest record),
+	 * the bytes used, including the skipped ends, and the buffer.
+	 */
+	uintptr_t		head;
+	uintptr_t		tail;
+	size_t			used;
+	uintptr_t		start;
+	uintptr_t		end;
+	tlsf_t *		tlsf;
+};
+
+/*
+ * tlsf_ring_create: create a ring, taking the block for the buffer of the
+ * given size from the space.  Returns NULL on failure.
+ */
+tlsf_ring_t *
+tlsf_ring_create(tlsf_t *tlsf, size_t size)
+{
+	tlsf_ring_t *ring;
+	size_t len;
+
+	if (tlsf->mode == TLSF_EXT || size == 0 || size > (SIZE_MAX >> 2)) {
+		return NULL;
+	}
+	size = roundup2(size, TLSF_RING_ALIGN);
+	len = sizeof(tlsf_ring_t) + size + TLSF_RING_ALIGN;
+	if ((ring = tlsf_alloc(tlsf, len)) == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * The records are at such offsets that the data following their
+	 * headers is aligned; the record lengths are multiples of the
+	 * alignment, therefore the offsets stay the same.
+	 */
+	ring->start = roundup2((uintptr_t)(ring + 1) + TLSF_RING_HDR,
+	    TLSF_RING_ALIGN) - TLSF_RING_HDR;
+	ring->end = ring->start + size;
+	ring->head = ring->tail = ring->start;
+	ring->used = 0;
+	ring->tlsf = tlsf;
+	return ring;
+}
+
+/*
+ * tlsf_ring_destroy: destroy the ring, releasing all of its records.
+ *
+ * => The records allocated on the fallback path must be freed separately.
+ */
+void
+tlsf_ring_destroy(tlsf_ring_t *ring)
+{
+	tlsf_free(ring->tlsf, ring);
+}
+
+static inline void *
+ring_take(tlsf_ring_t *ring, uintptr_t rec, size_t len)
+{
+	*(size_t *)rec = len;
+	ring->head = rec + len;
+	ring->used += len;
+	return (void *)(rec + TLSF_RING_HDR);
+}
+
+/*
+ * tlsf_ring_alloc: allocate the record at the head of the ring.  If the
+ * ring is full, fall back to tlsf_alloc().  Returns NULL on failure.
+ */
+void *
+tlsf_ring_alloc(tlsf_ring_t *ring, size_t size)
+{
+	const size_t len = roundup2(size + TLSF_RING_HDR, TLSF_RING_ALIGN);
+	const uintptr_t head = ring->head, tail = ring->tail;
+
+	if (__predict_false(size > len)) {
+		return NULL;
+	}
+	if (head < tail) {
+		/* Wrapped around: the free space is up to the tail. */
+		if (len <= tail - head) {
+			return ring_take(ring, head, len);
+		}
+	} else if (head > tail || ring->used == 0) {
+		/*
+		 * The free space is up to the end and from the start up
+		 * to the tail.  If the record does not fit at the end,
+		 * then skip it and wrap around.
+		 */
+		if (len <= ring->end - head) {
+			return ring_take(ring, head, len);
+		}
+		if (len <= tail - ring->start) {
+			if (head != ring->end) {
+				*(size_t *)head = (ring->end - head) |
+				    TLSF_RING_FREE;
+				ring->used += ring->end - head;
+			}
+			return ring_take(ring, ring->start, len);
+		}
+	}
+
+	/* The ring is full: fall back to the regular allocation. */
+	return tlsf_alloc(ring->tlsf, size);
+}
+
+/*
+ * tlsf_ring_free: release the record.  If it is the oldest record, then
+ * the tail advances over it and over the records freed out of order which
+ * follow it; otherwise, the record is only marked free.
+ */
+void
+tlsf_ring_free(tlsf_ring_t *ring, void *ptr)
+{
+	const uintptr_t rec = (uintptr_t)ptr - TLSF_RING_HDR;
+	size_t *hdr;
+
+	if (rec < ring->start || rec >= ring->end) {
+		tlsf_free(ring->tlsf, ptr);
+		return;
+	}
+	hdr = (size_t *)rec;
+	ASSERT((*hdr & TLSF_RING_FREE) == 0);
+	*hdr |= TLSF_RING_FREE;
+	if (rec != ring->tail) {
+		return;
+	}
+	while (ring->used) {
+		const size_t lenflags = *(size_t *)ring->tail;
+		const size_t len = lenflags & ~TLSF_RING_FREE;
+
+		if ((lenflags & TLSF_RING_FREE) == 0) {
+			break;
+		}
+		ASSERT(len <= ring->used);
+		ring->used -= len;
+		ring->tail += len;
+		if (ring->tail == ring->end) {
+			ring->tail = ring->start;
+		}
+	}
+
+	/* Empty: start over, so that the records do not wrap around. */
+	if (ring->used == 0) {
+		ring->head = ring->tail = ring->start;
+	}
+}
@@ -22,6 +22,14 @@
 #define	ASSERT(x)
 #endif
 
+/*
+ * Unused variable or parameter attribute.
+ */
+
+#ifndef __unused
+#define	__unused	__attribute__((__unused__))
+#endif
+
 /*
  * Branch prediction hints.
  */
@@ -31,6 +39,14 @@
 #define	__predict_false(x)	__builtin_expect((x) != 0, 0)
 #endif
 
+#ifndef MIN
+#define	MIN(x, y)	((x) < (y) ? (x) : (y))
+#endif
+
+#ifndef MAX
+#define	MAX(x, y)	((x) > (y) ? (x) : (y))
+#endif
+
 #ifndef __arraycount
 #define	__arraycount(__x)	(sizeof(__x) / sizeof(__x[0]))
 #endif
@@ -74,4 +90,16 @@ flsl(unsigned long x)
 #define	ilog2(x)	(flsl(x) - 1)
 #endif
 
+#ifndef ffs64
+#define	ffs64(x)	__builtin_ffsll(x)
+#endif
+
+#ifndef fls64
+static inline int
+fls64(uint64_t x)
+{
+	return __predict_true(x) ? 64 - __builtin_clzll(x) : 0;
+}
+#endif
+
 #endif